@@ -3,6 +3,28 @@
 #include <tuple>
 #include <queue>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 class DisjointSet {
 private:
@@ -44,15 +66,932 @@ public:
     }
 };
 
-void loadInputEdges(std::vector<std::tuple<int, int, int>>& edges, int R) {
-    for (int i = 0; i < R; i++) {
-        int n1, n2, cost;
-        std::cin >> n1 >> n2 >> cost;
-        edges.emplace_back(n1, n2, cost);
+// Placement of big arrays, read once from PAL_HUGEPAGES (thp, hugetlb, off) and PAL_NUMA (interleave, firsttouch)
+struct LargeArrayConfig {
+    bool hugePages = true;
+    bool hugetlb = false;
+    bool interleave = false;
+    bool firstTouch = false;
+    unsigned long nodeMask = 0;
+    std::atomic<long long> hugePageBytes{0};
+    std::atomic<long long> hugetlbBytes{0};
+
+    LargeArrayConfig() {
+        const char* hugePagesEnv = std::getenv("PAL_HUGEPAGES");
+        if (hugePagesEnv != nullptr) {
+            hugePages = std::string(hugePagesEnv) != "off";
+            hugetlb = std::string(hugePagesEnv) == "hugetlb";
+        }
+
+        const char* numaEnv = std::getenv("PAL_NUMA");
+        if (numaEnv != nullptr) {
+            interleave = std::string(numaEnv) == "interleave";
+            firstTouch = std::string(numaEnv) == "firsttouch";
+        }
+
+        // Online NUMA nodes, e.g. "0-1" or "0,2", without libnuma
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string ranges;
+        if (online >> ranges) {
+            std::stringstream stream(ranges);
+            std::string range;
+            while (std::getline(stream, range, ',')) {
+                size_t dash = range.find('-');
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int node = first; node <= last && node < 64; node++) {
+                    nodeMask |= 1UL << node;
+                }
+            }
+        }
+    }
+
+    int numNodes() const {
+        return __builtin_popcountl(nodeMask);
+    }
+
+    static LargeArrayConfig& get() {
+        static LargeArrayConfig config;
+        return config;
+    }
+};
+
+// Allocator for the big flat arrays: 2 MiB aligned mappings backed by huge pages and placed across NUMA nodes
+template <typename T>
+class LargeArrayAllocator {
+private:
+    static const size_t hugePageSize = 2 << 20;
+
+    static size_t mappedSize(size_t bytes) {
+        return (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+    }
+
+public:
+    typedef T value_type;
+
+    LargeArrayAllocator() = default;
+
+    template <typename U>
+    LargeArrayAllocator(const LargeArrayAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < hugePageSize) {
+            // Small arrays are not worth a mapping of their own
+            return static_cast<T*>(::operator new(bytes));
+        }
+
+        LargeArrayConfig& config = LargeArrayConfig::get();
+        size_t size = mappedSize(bytes);
+        void* memory = MAP_FAILED;
+
+        if (config.hugetlb) {
+            // Explicit huge pages from hugetlbfs, falls back to normal pages when none are reserved
+            memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED) {
+                config.hugetlbBytes += size;
+            }
+        }
+        if (memory == MAP_FAILED) {
+            memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            if (config.hugePages && madvise(memory, size, MADV_HUGEPAGE) == 0) {
+                config.hugePageBytes += size;
+            }
+        }
+
+        if (config.interleave && config.numNodes() > 1) {
+            // Spread pages round-robin over all nodes, ignore failure (e.g. seccomp) and keep the default policy
+            const int mpolInterleave = 3;
+            syscall(SYS_mbind, memory, size, mpolInterleave, &config.nodeMask, sizeof(config.nodeMask) * 8 + 1, 0);
+        }
+
+        if (config.firstTouch) {
+            // Best-effort pre-fault: zero the pages from several threads, so they are not all placed on the node of
+            // the allocating thread. The threads are not pinned and are not the ones that traverse the array later,
+            // so where each part ends up is up to the scheduler
+            int numThreads = std::max(1u, std::thread::hardware_concurrency());
+            size_t chunk = mappedSize((size + numThreads - 1) / numThreads);
+            std::vector<std::thread> threads;
+            for (size_t from = 0; from < size; from += chunk) {
+                threads.emplace_back([=]() {
+                    std::memset(static_cast<char*>(memory) + from, 0, std::min(chunk, size - from));
+                });
+            }
+            for (size_t i = 0; i < threads.size(); i++) {
+                threads[i].join();
+            }
+        }
+
+        return static_cast<T*>(memory);
+    }
+
+    void deallocate(T* pointer, size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < hugePageSize) {
+            ::operator delete(pointer);
+            return;
+        }
+        munmap(pointer, mappedSize(bytes));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const LargeArrayAllocator<T>&, const LargeArrayAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const LargeArrayAllocator<T>&, const LargeArrayAllocator<U>&) {
+    return false;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Digit mask of 64 bytes, bit i is set when block[i] is '0' .. '9'
+__attribute__((target("sse4.2")))
+uint64_t digitMaskSse42(const char* block) {
+    // c - '0' <= 9 as unsigned bytes, min(x, 9) == x is the unsigned compare SSE lacks
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i x = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(block + 16 * i)), zero);
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, nine), x)) << (16 * i);
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+uint64_t digitMaskAvx2(const char* block) {
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+    __m256i low = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)block), zero);
+    __m256i high = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)(block + 32)), zero);
+    uint32_t lowMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(low, nine), low));
+    uint32_t highMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(high, nine), high));
+    return (uint64_t)highMask << 32 | lowMask;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+uint64_t digitMaskAvx512(const char* block) {
+    __m512i x = _mm512_sub_epi8(_mm512_loadu_si512(block), _mm512_set1_epi8('0'));
+    return _mm512_cmple_epu8_mask(x, _mm512_set1_epi8(9));
+}
+#endif
+
+// One Prim step over a row of the weight matrix: key[i] = min(key[i], max(row[i], blocked[i])), returns the smallest key,
+// blocked[i] is INT_MAX for nodes already in the tree (their key stays INT_MAX) and INT_MIN for the others
+int relaxRowScalar(int* key, const int* row, const int* blocked, int n) {
+    int best = INT_MAX;
+    for (int i = 0; i < n; i++) {
+        key[i] = std::min(key[i], std::max(row[i], blocked[i]));
+        best = std::min(best, key[i]);
+    }
+    return best;
+}
+
+// Index of the first value equal to value, -1 if there is none
+int findValueScalar(const int* values, int n, int value) {
+    for (int i = 0; i < n; i++) {
+        if (values[i] == value) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2")))
+int relaxRowSse42(int* key, const int* row, const int* blocked, int n) {
+    __m128i best = _mm_set1_epi32(INT_MAX);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i relaxed = _mm_max_epi32(_mm_loadu_si128((const __m128i*)(row + i)), _mm_loadu_si128((const __m128i*)(blocked + i)));
+        __m128i k = _mm_min_epi32(_mm_loadu_si128((const __m128i*)(key + i)), relaxed);
+        _mm_storeu_si128((__m128i*)(key + i), k);
+        best = _mm_min_epi32(best, k);
+    }
+    best = _mm_min_epi32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = _mm_min_epi32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+    return std::min(_mm_cvtsi128_si32(best), relaxRowScalar(key + i, row + i, blocked + i, n - i));
+}
+
+__attribute__((target("sse4.2")))
+int findValueSse42(const int* values, int n, int value) {
+    __m128i wanted = _mm_set1_epi32(value);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(values + i)), wanted)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    int tail = findValueScalar(values + i, n - i, value);
+    return tail == -1 ? -1 : i + tail;
+}
+
+__attribute__((target("avx2")))
+int relaxRowAvx2(int* key, const int* row, const int* blocked, int n) {
+    __m256i best = _mm256_set1_epi32(INT_MAX);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i relaxed = _mm256_max_epi32(_mm256_loadu_si256((const __m256i*)(row + i)), _mm256_loadu_si256((const __m256i*)(blocked + i)));
+        __m256i k = _mm256_min_epi32(_mm256_loadu_si256((const __m256i*)(key + i)), relaxed);
+        _mm256_storeu_si256((__m256i*)(key + i), k);
+        best = _mm256_min_epi32(best, k);
+    }
+    __m128i half = _mm_min_epi32(_mm256_castsi256_si128(best), _mm256_extracti128_si256(best, 1));
+    half = _mm_min_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_min_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return std::min(_mm_cvtsi128_si32(half), relaxRowScalar(key + i, row + i, blocked + i, n - i));
+}
+
+__attribute__((target("avx2")))
+int findValueAvx2(const int* values, int n, int value) {
+    __m256i wanted = _mm256_set1_epi32(value);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(values + i)), wanted)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    int tail = findValueScalar(values + i, n - i, value);
+    return tail == -1 ? -1 : i + tail;
+}
+
+// The unmasked AVX-512 intrinsics start from an undefined vector, gcc 12 reports it as uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f,avx2")))
+int relaxRowAvx512(int* key, const int* row, const int* blocked, int n) {
+    __m512i best = _mm512_set1_epi32(INT_MAX);
+    for (int i = 0; i < n; i += 16) {
+        // The last block is masked, lanes past n keep INT_MAX
+        __mmask16 lanes = n - i >= 16 ? 0xffff : (__mmask16)((1u << (n - i)) - 1);
+        __m512i relaxed = _mm512_max_epi32(_mm512_maskz_loadu_epi32(lanes, row + i), _mm512_maskz_loadu_epi32(lanes, blocked + i));
+        __m512i k = _mm512_min_epi32(_mm512_mask_loadu_epi32(best, lanes, key + i), relaxed);
+        _mm512_mask_storeu_epi32(key + i, lanes, k);
+        best = _mm512_mask_min_epi32(best, lanes, best, k);
+    }
+    __m256i half = _mm256_min_epi32(_mm512_extracti64x4_epi64(best, 0), _mm512_extracti64x4_epi64(best, 1));
+    __m128i quarter = _mm_min_epi32(_mm256_castsi256_si128(half), _mm256_extracti128_si256(half, 1));
+    quarter = _mm_min_epi32(quarter, _mm_shuffle_epi32(quarter, _MM_SHUFFLE(1, 0, 3, 2)));
+    quarter = _mm_min_epi32(quarter, _mm_shuffle_epi32(quarter, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(quarter);
+}
+#pragma GCC diagnostic pop
+
+__attribute__((target("avx512f")))
+int findValueAvx512(const int* values, int n, int value) {
+    __m512i wanted = _mm512_set1_epi32(value);
+    for (int i = 0; i < n; i += 16) {
+        __mmask16 lanes = n - i >= 16 ? 0xffff : (__mmask16)((1u << (n - i)) - 1);
+        __mmask16 mask = _mm512_mask_cmpeq_epi32_mask(lanes, _mm512_maskz_loadu_epi32(lanes, values + i), wanted);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return -1;
+}
+#endif
+
+// Vectorised kernels, compiled for several instruction sets and picked once at start-up from the CPU,
+// PAL_SIMD (scalar, sse4.2, avx2, avx512) forces a level, a level the CPU lacks falls back to the best one it has
+struct SimdKernels {
+    enum Level { SCALAR, SSE42, AVX2, AVX512 };
+
+    Level level = SCALAR;
+    uint64_t (*digitMask)(const char* block) = nullptr;    // none on the scalar level, integers are parsed byte by byte
+    int (*relaxRow)(int* key, const int* row, const int* blocked, int n) = relaxRowScalar;
+    int (*findValue)(const int* values, int n, int value) = findValueScalar;
+
+    static const char* levelName(Level level) {
+        const char* names[] = {"scalar", "sse4.2", "avx2", "avx512"};
+        return names[level];
+    }
+
+    SimdKernels() {
+        Level best = SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2")) {
+            best = SSE42;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            best = AVX2;
+        }
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+            best = AVX512;
+        }
+#endif
+        level = best;
+        const char* simdEnv = std::getenv("PAL_SIMD");
+        if (simdEnv != nullptr) {
+            for (int i = SCALAR; i <= AVX512; i++) {
+                if (std::string(simdEnv) == levelName((Level)i)) {
+                    level = std::min(best, (Level)i);
+                }
+            }
+        }
+
+#if defined(__x86_64__) || defined(__i386__)
+        if (level == SSE42) {
+            digitMask = digitMaskSse42;
+            relaxRow = relaxRowSse42;
+            findValue = findValueSse42;
+        } else if (level == AVX2) {
+            digitMask = digitMaskAvx2;
+            relaxRow = relaxRowAvx2;
+            findValue = findValueAvx2;
+        } else if (level == AVX512) {
+            digitMask = digitMaskAvx512;
+            relaxRow = relaxRowAvx512;
+            findValue = findValueAvx512;
+        }
+#endif
+    }
+
+    static const SimdKernels& get() {
+        static SimdKernels kernels;
+        return kernels;
+    }
+};
+
+// Hardware counter for the phase report, reads -1 when perf events are not available
+class PerfCounter {
+private:
+    int fd = -1;
+
+public:
+    PerfCounter() = default;
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    void open(unsigned int type, unsigned long long config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // Count threads spawned later as well, their counts are added when they exit (all are joined within a phase)
+        attr.inherit = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~PerfCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    long long read() const {
+        long long value = -1;
+        if (fd < 0 || ::read(fd, &value, sizeof(value)) != sizeof(value)) {
+            return -1;
+        }
+        return value;
+    }
+
+    static unsigned long long cacheMisses(unsigned long long cache) {
+        return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    }
+};
+
+class PhaseReport {
+private:
+    struct Phase {
+        std::string name;
+        double ms;
+        long long tlbMisses;
+        long long remoteMisses;
+    };
+
+    bool enabled;
+    std::vector<Phase> phases;
+    std::vector<std::string> notes;
+    std::string phaseName;
+    std::chrono::steady_clock::time_point phaseStart;
+    PerfCounter tlbCounter;
+    PerfCounter remoteCounter;
+    long long tlbStart = 0;
+    long long remoteStart = 0;
+
+    static long long delta(long long end, long long start) {
+        return end < 0 || start < 0 ? -1 : end - start;
+    }
+
+    static std::string counterText(long long value) {
+        return value < 0 ? "n/a" : std::to_string(value);
+    }
+
+public:
+    PhaseReport(bool enabled) : enabled(enabled) {
+        if (enabled) {
+            // dTLB load misses and loads served by a remote NUMA node
+            tlbCounter.open(PERF_TYPE_HW_CACHE, PerfCounter::cacheMisses(PERF_COUNT_HW_CACHE_DTLB));
+            remoteCounter.open(PERF_TYPE_HW_CACHE, PerfCounter::cacheMisses(PERF_COUNT_HW_CACHE_NODE));
+        }
+    }
+
+    bool isEnabled() const {
+        return enabled;
+    }
+
+    void start(const std::string& name) {
+        phaseName = name;
+        tlbStart = tlbCounter.read();
+        remoteStart = remoteCounter.read();
+        phaseStart = std::chrono::steady_clock::now();
+    }
+
+    double stop() {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - phaseStart).count();
+        phases.push_back({phaseName, ms, delta(tlbCounter.read(), tlbStart), delta(remoteCounter.read(), remoteStart)});
+        return ms;
+    }
+
+    double total(const std::string& name) const {
+        double ms = 0;
+        for (size_t i = 0; i < phases.size(); i++) {
+            if (phases[i].name == name) {
+                ms += phases[i].ms;
+            }
+        }
+        return ms;
+    }
+
+    void note(const std::string& line) {
+        notes.push_back(line);
+    }
+
+    void print() const {
+        if (!enabled) {
+            return;
+        }
+        // Report goes to stderr so the answer on stdout stays clean
+        for (size_t i = 0; i < phases.size(); i++) {
+            std::cerr << "phase " << phases[i].name << ": " << phases[i].ms << " ms, dTLB misses "
+                << counterText(phases[i].tlbMisses) << ", remote node misses " << counterText(phases[i].remoteMisses) << std::endl;
+        }
+
+        // How much of the process memory really ended up on huge pages
+        const LargeArrayConfig& config = LargeArrayConfig::get();
+        std::ifstream smaps("/proc/self/smaps_rollup");
+        std::string line;
+        std::string anonHugePages = "n/a";
+        while (std::getline(smaps, line)) {
+            if (line.compare(0, 14, "AnonHugePages:") == 0) {
+                anonHugePages = line.substr(14);
+                anonHugePages.erase(0, anonHugePages.find_first_not_of(' '));
+            }
+        }
+        std::cerr << "huge pages: " << (config.hugePageBytes >> 20) << " MiB advised, " << (config.hugetlbBytes >> 20)
+            << " MiB hugetlbfs, AnonHugePages " << anonHugePages << std::endl;
+        std::cerr << "simd: " << SimdKernels::levelName(SimdKernels::get().level) << std::endl;
+        std::cerr << "numa: " << config.numNodes() << " nodes, placement "
+            << (config.interleave ? "interleave" : config.firstTouch ? "firsttouch" : "default") << std::endl;
+
+        for (size_t i = 0; i < notes.size(); i++) {
+            std::cerr << notes[i] << std::endl;
+        }
+    }
+};
+
+typedef std::vector<std::tuple<int, int, int>, LargeArrayAllocator<std::tuple<int, int, int>>> EdgeList;
+
+// Adjacency list in two flat arrays, neighbours of node i are neighbour[start[i]] .. neighbour[start[i + 1] - 1]
+struct FlatAdjacencyList {
+    std::vector<int, LargeArrayAllocator<int>> start;
+    std::vector<int, LargeArrayAllocator<int>> neighbour;
+
+    int degree(int node) const {
+        return start[node + 1] - start[node];
+    }
+
+    const int* begin(int node) const {
+        return neighbour.data() + start[node];
+    }
+
+    const int* end(int node) const {
+        return neighbour.data() + start[node + 1];
+    }
+};
+
+void runTasksInParallel(int numTasks, const std::function<void(int)>& task) {
+    int numThreads = std::min<int>(std::max(1u, std::thread::hardware_concurrency()), numTasks);
+    std::atomic<int> nextTask(0);
+
+    auto worker = [&]() {
+        // Take tasks one by one until all of them are done
+        for (int i = nextTask++; i < numTasks; i = nextTask++) {
+            task(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numThreads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+}
+
+std::vector<char> readRemainingInput() {
+    std::vector<char> buffer;
+    size_t length = 0;
+
+    // Reserve the whole rest of the file at once when stdin is a regular file
+    struct stat info;
+    long position = std::ftell(stdin);
+    if (fstat(fileno(stdin), &info) == 0 && S_ISREG(info.st_mode) && position >= 0 && info.st_size > position) {
+        buffer.resize(info.st_size - position + 1);
+    }
+
+    while (true) {
+        if (length == buffer.size()) {
+            buffer.resize(std::max<size_t>(1 << 16, 2 * buffer.size()));
+        }
+        size_t bytesRead = std::fread(buffer.data() + length, 1, buffer.size() - length, stdin);
+        if (bytesRead == 0) {
+            break;
+        }
+        length += bytesRead;
+    }
+
+    buffer.resize(length);
+    return buffer;
+}
+
+const char* parseInteger(const char* it, const char* end, int& value, bool& found) {
+    // Skip everything up to the next number, a minus sign counts only right before a digit
+    while (it != end && !(*it >= '0' && *it <= '9') && !(*it == '-' && it + 1 != end && it[1] >= '0' && it[1] <= '9')) {
+        ++it;
+    }
+    found = it != end;
+    if (!found) {
+        return it;
+    }
+
+    bool negative = *it == '-';
+    if (negative) {
+        ++it;
+    }
+    value = 0;
+    while (it != end && *it >= '0' && *it <= '9') {
+        value = value * 10 + (*it - '0');
+        ++it;
+    }
+    if (negative) {
+        value = -value;
+    }
+    return it;
+}
+
+// Value of the first length (at most 8) digits at it, all 8 bytes are read at once
+inline int parseEightDigits(const char* it, int length) {
+    uint64_t chunk;
+    std::memcpy(&chunk, it, 8);
+    // Bytes after the digits may borrow while subtracting '0', but only upwards and they are shifted out,
+    // the shift moves the first digit to the top as if the number had leading zeros
+    chunk = (chunk - 0x3030303030303030ULL) << (8 * (8 - length));
+    chunk = chunk * 10 + (chunk >> 8);
+    chunk = ((chunk & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))
+        + ((chunk >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32))) >> 32;
+    return (int)chunk;
+}
+
+// Parses all integers of [begin, end) into numbers, finding them through the digit mask of 64-byte blocks
+void parseIntegerRange(const char* begin, const char* end, std::vector<int>& numbers) {
+    uint64_t (*digitMask)(const char* block) = SimdKernels::get().digitMask;
+    const char* it = begin;
+    int value;
+    bool found;
+    while (digitMask != nullptr && end - it >= 64) {
+        uint64_t digits = digitMask(it);
+        if (digits == ~0ULL) {
+            // Number longer than a block, its minus sign is just before the block
+            it = parseInteger(it > begin && it[-1] == '-' ? it - 1 : it, end, value, found);
+            numbers.push_back(value);
+            continue;
+        }
+
+        // A number touching the block end may go on, it is parsed with the next block
+        const char* next = it + 64;
+        if (digits >> 63) {
+            int lastStart = 64 - __builtin_clzll(~digits);
+            digits &= (1ULL << lastStart) - 1;
+            next = it + lastStart;
+        }
+
+        uint64_t starts = digits & ~(digits << 1);
+        while (starts != 0) {
+            int first = __builtin_ctzll(starts);
+            int last = first + __builtin_ctzll(~(digits >> first));
+            if (last - first <= 8 && end - (it + first) >= 8) {
+                value = parseEightDigits(it + first, last - first);
+            } else {
+                value = 0;
+                for (int i = first; i < last; i++) {
+                    value = value * 10 + (it[i] - '0');
+                }
+            }
+            // A minus sign counts only right before a digit
+            bool negative = first > 0 ? it[first - 1] == '-' : it > begin && it[-1] == '-';
+            numbers.push_back(negative ? -value : value);
+            starts &= starts - 1;
+        }
+        it = next;
+    }
+
+    // Tail shorter than a block, or everything on the scalar level
+    if (it > begin && it[-1] == '-') {
+        --it;
+    }
+    while (true) {
+        it = parseInteger(it, end, value, found);
+        if (!found) {
+            break;
+        }
+        numbers.push_back(value);
+    }
+}
+
+// Parses the first count integers of the buffer with all cores and hands them to store(index, value),
+// returns the offset right after the last parsed integer
+template <typename Store>
+size_t parseIntegersInParallel(const std::vector<char>& buffer, size_t count, Store store) {
+    if (count == 0) {
+        return 0;
+    }
+    const char* data = buffer.data();
+    const char* dataEnd = data + buffer.size();
+
+    // Split the buffer into chunks that end on a whitespace, so no number is cut in half
+    int numChunks = std::max(1u, std::thread::hardware_concurrency()) * 4;
+    std::vector<const char*> chunkStart(numChunks + 1, dataEnd);
+    chunkStart[0] = data;
+    for (int c = 1; c < numChunks; c++) {
+        const char* it = std::max(chunkStart[c - 1], data + buffer.size() / numChunks * c);
+        while (it != dataEnd && !std::isspace((unsigned char)*it)) {
+            ++it;
+        }
+        chunkStart[c] = it;
+    }
+
+    // Every chunk is parsed into its own buffer
+    std::vector<std::vector<int>> chunkNumbers(numChunks);
+    runTasksInParallel(numChunks, [&](int c) {
+        std::vector<int>& numbers = chunkNumbers[c];
+        numbers.reserve((chunkStart[c + 1] - chunkStart[c]) / 4);
+        parseIntegerRange(chunkStart[c], chunkStart[c + 1], numbers);
+    });
+
+    // Merge chunk buffers into their place in the output
+    std::vector<size_t> firstIndex(numChunks + 1, 0);
+    for (int c = 0; c < numChunks; c++) {
+        firstIndex[c + 1] = firstIndex[c] + chunkNumbers[c].size();
+    }
+    runTasksInParallel(numChunks, [&](int c) {
+        for (size_t i = 0; i < chunkNumbers[c].size() && firstIndex[c] + i < count; i++) {
+            store(firstIndex[c] + i, chunkNumbers[c][i]);
+        }
+    });
+
+    // Find where the last wanted number ends, the rest of the input stays for the caller
+    if (firstIndex[numChunks] <= count) {
+        return buffer.size();
+    }
+    int lastChunk = std::upper_bound(firstIndex.begin(), firstIndex.end(), count - 1) - firstIndex.begin() - 1;
+    const char* it = chunkStart[lastChunk];
+    int value;
+    bool found;
+    for (size_t i = firstIndex[lastChunk]; i < count; i++) {
+        it = parseInteger(it, chunkStart[lastChunk + 1], value, found);
+    }
+    return it - data;
+}
+
+void loadInputEdges(EdgeList& edges, int R, std::string& rest) {
+    std::vector<char> buffer = readRemainingInput();
+
+    // Every edge is three integers n1, n2, cost
+    edges.resize(R);
+    size_t end = parseIntegersInParallel(buffer, 3 * (size_t)R, [&](size_t index, int value) {
+        std::tuple<int, int, int>& edge = edges[index / 3];
+        if (index % 3 == 0) {
+            std::get<0>(edge) = value;
+        } else if (index % 3 == 1) {
+            std::get<1>(edge) = value;
+        } else {
+            std::get<2>(edge) = value;
+        }
+    });
+
+    // Whatever follows the edges (update batches) is read later
+    rest.assign(buffer.begin() + end, buffer.end());
+}
+
+// Bounded lock-free queue for exactly one producer and one consumer thread
+template <typename T>
+class SpscQueue {
+private:
+    std::vector<T> slots;
+    std::atomic<size_t> head;   // next slot to pop
+    std::atomic<size_t> tail;   // next slot to push
+
+public:
+    SpscQueue(size_t capacity) : slots(capacity + 1), head(0), tail(0) {}
+
+    bool tryPush(const T& value) {
+        size_t current = tail.load(std::memory_order_relaxed);
+        size_t next = (current + 1) % slots.size();
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[current] = value;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        size_t current = head.load(std::memory_order_relaxed);
+        if (current == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[current];
+        head.store((current + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    void push(const T& value) {
+        while (!tryPush(value)) {
+            std::this_thread::yield();
+        }
+    }
+
+    T pop() {
+        T value;
+        while (!tryPop(value)) {
+            std::this_thread::yield();
+        }
+        return value;
+    }
+};
+
+// Parses integers from stdin on its own thread and hands them over in fixed-size batches,
+// at most numBatches batches exist at once, so memory stays bounded whatever the input size
+class IntegerStream {
+private:
+    static const size_t batchSize = 1 << 16;
+    static const size_t blockSize = 1 << 20;
+    static const int numBatches = 8;
+
+    std::vector<std::vector<int>> batches;
+    SpscQueue<int> filledBatches;
+    SpscQueue<int> freeBatches;
+    int currentBatch = -1;
+    std::string rest;
+    std::thread reader;
+
+    void readInput(size_t count) {
+        std::vector<char> block(blockSize);
+        int batch = freeBatches.pop();
+        size_t parsed = 0;
+        int value = 0;
+        bool inNumber = false;
+        bool negative = false;
+        bool afterMinus = false;
+        size_t bytesRead = 0;
+        size_t restStart = 0;
+        bool stoppedInBlock = false;
+
+        auto emit = [&]() {
+            batches[batch].push_back(negative ? -value : value);
+            parsed++;
+            inNumber = false;
+            if (batches[batch].size() == batchSize) {
+                filledBatches.push(batch);
+                batch = freeBatches.pop();
+                batches[batch].clear();
+            }
+        };
+
+        // The state of a number is kept between blocks, so numbers split by a block border are fine
+        while (parsed < count) {
+            bytesRead = std::fread(block.data(), 1, blockSize, stdin);
+            if (bytesRead == 0) {
+                break;
+            }
+            for (restStart = 0; restStart < bytesRead; restStart++) {
+                char c = block[restStart];
+                if (c >= '0' && c <= '9') {
+                    if (!inNumber) {
+                        inNumber = true;
+                        negative = afterMinus;
+                        value = 0;
+                    }
+                    value = value * 10 + (c - '0');
+                } else if (inNumber) {
+                    emit();
+                    if (parsed == count) {
+                        stoppedInBlock = true;
+                        break;
+                    }
+                }
+                afterMinus = c == '-';
+            }
+        }
+        if (inNumber && parsed < count) {
+            // Last number ends with the input
+            emit();
+        }
+
+        // Flush the last partial batch and mark the end with an empty one
+        if (!batches[batch].empty()) {
+            filledBatches.push(batch);
+            batch = freeBatches.pop();
+        }
+        batches[batch].clear();
+        filledBatches.push(batch);
+
+        // Whatever follows the wanted integers stays for the caller, all of the input when none were wanted
+        // and nothing when the last one ended the input
+        if (stoppedInBlock) {
+            rest.assign(block.begin() + restStart, block.begin() + bytesRead);
+        }
+        if (parsed == count) {
+            while ((bytesRead = std::fread(block.data(), 1, blockSize, stdin)) > 0) {
+                rest.append(block.begin(), block.begin() + bytesRead);
+            }
+        }
+    }
+
+public:
+    IntegerStream(size_t count) : batches(numBatches), filledBatches(numBatches), freeBatches(numBatches) {
+        for (int i = 0; i < numBatches; i++) {
+            batches[i].reserve(batchSize);
+            freeBatches.push(i);
+        }
+        reader = std::thread(&IntegerStream::readInput, this, count);
+    }
+
+    ~IntegerStream() {
+        if (reader.joinable()) {
+            reader.join();
+        }
+    }
+
+    // Returns the next batch, the previous one is given back to the reader, empty batch means the end
+    const std::vector<int>& nextBatch() {
+        if (currentBatch >= 0) {
+            freeBatches.push(currentBatch);
+        }
+        currentBatch = filledBatches.pop();
+        return batches[currentBatch];
+    }
+
+    // Input that follows the wanted integers, call after the empty batch was returned
+    std::string takeRest() {
+        reader.join();
+        return rest;
+    }
+};
+
+void streamInputEdges(EdgeList& edges, int R, FlatAdjacencyList& adjacencyList, int T, std::string& rest) {
+    // Edges are stored and degrees counted while the reader thread is still parsing
+    IntegerStream stream(3 * (size_t)R);
+    adjacencyList.start.assign(T + 2, 0);
+    int edge[3];
+    size_t index = 0;
+
+    while (true) {
+        const std::vector<int>& batch = stream.nextBatch();
+        if (batch.empty()) {
+            break;
+        }
+        for (size_t i = 0; i < batch.size(); i++, index++) {
+            edge[index % 3] = batch[i];
+            if (index % 3 == 2) {
+                edges.emplace_back(edge[0], edge[1], edge[2]);
+                adjacencyList.start[edge[0] + 1]++;
+                adjacencyList.start[edge[1] + 1]++;
+            }
+        }
     }
+
+    rest = stream.takeRest();
 }
 
-void printEdges(const std::vector<std::tuple<int, int, int>>& edges) {
+void printEdges(const EdgeList& edges) {
     for (size_t i = 0; i < edges.size(); i++) {
         int n1, n2, cost;
         std::tie(n1, n2, cost) = edges[i];
@@ -60,37 +999,67 @@ void printEdges(const std::vector<std::tuple<int, int, int>>& edges) {
     }
 }
 
-void createAdjacencyList(
-    const std::vector<std::tuple<int, int, int>>& edges,
-    std::vector<std::vector<int>>& adjacencyList
-) {
+void fillAdjacencyList(const EdgeList& edges, FlatAdjacencyList& adjacencyList, int T) {
+    // Expects degree of node i in start[i + 1]
+    for (int i = 1; i < T + 2; i++) {
+        adjacencyList.start[i] += adjacencyList.start[i - 1];
+    }
+
+    // Fill neighbours in the order of edges
+    std::vector<int> position(adjacencyList.start.begin(), adjacencyList.start.end() - 1);
+    adjacencyList.neighbour.resize(2 * edges.size());
     for (size_t i = 0; i < edges.size(); i++) {
         int n1, n2, cost;
         std::tie(n1, n2, cost) = edges[i];
-        adjacencyList[n1].push_back(n2);
-        adjacencyList[n2].push_back(n1);
+        adjacencyList.neighbour[position[n1]++] = n2;
+        adjacencyList.neighbour[position[n2]++] = n1;
+    }
+}
+
+void createAdjacencyList(const EdgeList& edges, FlatAdjacencyList& adjacencyList, int T) {
+    // Count degrees
+    adjacencyList.start.assign(T + 2, 0);
+    for (size_t i = 0; i < edges.size(); i++) {
+        adjacencyList.start[std::get<0>(edges[i]) + 1]++;
+        adjacencyList.start[std::get<1>(edges[i]) + 1]++;
     }
+
+    fillAdjacencyList(edges, adjacencyList, T);
 }
  
-void printAdjacencyList(const std::vector<std::vector<int>>& adjacencyList) {
-    for (size_t i = 1; i < adjacencyList.size(); i++) {
+void printAdjacencyList(const FlatAdjacencyList& adjacencyList) {
+    for (size_t i = 1; i + 1 < adjacencyList.start.size(); i++) {
         std::cout << i << ": ";
-        for (size_t j = 0; j < adjacencyList[i].size(); j++) {
-            std::cout << adjacencyList[i][j] << " ";
+        for (const int* it = adjacencyList.begin(i); it != adjacencyList.end(i); ++it) {
+            std::cout << *it << " ";
         }
         std::cout << "\n";
     }
 }
 
-void runBfsSearch(std::vector<int>& districtOf, int T, int D, const std::vector<std::vector<int>>& adjacencyList) {
+void runBfsSearch(
+    std::vector<int>& districtOf, int T, int D, const FlatAdjacencyList& adjacencyList,
+    std::vector<int>* levelOf = nullptr, std::vector<int>* parentOf = nullptr
+) {
     std::queue<std::pair<int, int>> queue;
     std::vector<bool> visited(T + 1, false);
+
+    // Optionally remember the BFS tree (-1 for nodes that are not reached)
+    if (levelOf != nullptr) {
+        levelOf->assign(T + 1, -1);
+    }
+    if (parentOf != nullptr) {
+        parentOf->assign(T + 1, -1);
+    }
     
     // Add district nodes to queue
     for (int i = 1; i < D + 1; i++) {
         queue.emplace(i, i);
         districtOf[i] = i;
         visited[i] = true;
+        if (levelOf != nullptr) {
+            (*levelOf)[i] = 0;
+        }
     }
 
     while (!queue.empty()) {
@@ -100,9 +1069,10 @@ void runBfsSearch(std::vector<int>& districtOf, int T, int D, const std::vector<
         int node = topValue.first;
         int district = topValue.second;
 
-        const std::vector<int>& neighbours = adjacencyList[node];
+        const int* neighbours = adjacencyList.begin(node);
+        int numNeighbours = adjacencyList.degree(node);
         
-        for (size_t j = 0; j < neighbours.size(); j++) {
+        for (int j = 0; j < numNeighbours; j++) {
             int neighbour = neighbours[j];
             // Check if neighbour is visited
             if (visited[neighbour] == true) {
@@ -115,7 +1085,80 @@ void runBfsSearch(std::vector<int>& districtOf, int T, int D, const std::vector<
             districtOf[neighbour] = district;
             // Set as visited
             visited[neighbour] = true;
+
+            if (levelOf != nullptr) {
+                (*levelOf)[neighbour] = (*levelOf)[node] + 1;
+            }
+            if (parentOf != nullptr) {
+                (*parentOf)[neighbour] = node;
+            }
+        }
+    }
+}
+
+std::vector<int> computeNodeOrder(const FlatAdjacencyList& adjacencyList, int T, int D, const std::string& method) {
+    // Returns new id of every node, district nodes keep ids 1..D so the BFS seeds stay the same
+    std::vector<int> order;
+    order.reserve(T);
+
+    if (method == "bfs" || method == "rcm") {
+        // Visit nodes in BFS order from the district nodes, RCM takes neighbours by increasing degree
+        std::vector<bool> visited(T + 1, false);
+        std::vector<int> neighbours;
+        for (int i = 1; i <= D; i++) {
+            visited[i] = true;
+            order.push_back(i);
+        }
+        size_t head = 0;
+        for (int seed = 1; seed <= T; seed++) {
+            if (!visited[seed]) {
+                // Node not reachable from the nodes queued so far
+                visited[seed] = true;
+                order.push_back(seed);
+            }
+            while (head < order.size()) {
+                int node = order[head++];
+                neighbours.assign(adjacencyList.begin(node), adjacencyList.end(node));
+                if (method == "rcm") {
+                    std::stable_sort(neighbours.begin(), neighbours.end(), [&](int a, int b) {
+                        return adjacencyList.degree(a) < adjacencyList.degree(b);
+                    });
+                }
+                for (size_t j = 0; j < neighbours.size(); j++) {
+                    if (!visited[neighbours[j]]) {
+                        visited[neighbours[j]] = true;
+                        order.push_back(neighbours[j]);
+                    }
+                }
+            }
+        }
+        if (method == "rcm") {
+            std::reverse(order.begin() + D, order.end());
+        }
+    } else if (method == "degree") {
+        // Hubs first, so the most often touched nodes share cache lines
+        for (int i = 1; i <= T; i++) {
+            order.push_back(i);
         }
+        std::stable_sort(order.begin() + D, order.end(), [&](int a, int b) {
+            return adjacencyList.degree(a) > adjacencyList.degree(b);
+        });
+    } else {
+        std::cerr << "Unknown node order: " << method << std::endl;
+        return std::vector<int>();
+    }
+
+    std::vector<int> newId(T + 1, 0);
+    for (int i = 0; i < T; i++) {
+        newId[order[i]] = i + 1;
+    }
+    return newId;
+}
+
+void relabelEdges(EdgeList& edges, const std::vector<int>& newId) {
+    for (size_t i = 0; i < edges.size(); i++) {
+        std::get<0>(edges[i]) = newId[std::get<0>(edges[i])];
+        std::get<1>(edges[i]) = newId[std::get<1>(edges[i])];
     }
 }
 
@@ -126,45 +1169,787 @@ void printDistrictOf(const std::vector<int>& districtOf) {
     }
 }
 
-int computeMinWeight(std::vector<std::tuple<int, int, int>>& edges, const std::vector<int>& districtOf, int T, int D) {
-    int minWeight = 0;
-    DisjointSet dsNodesInDistrict(T);
-    DisjointSet dsDistrictNodes(D);
+void partitionEdgesByDistrict(
+    const EdgeList& edges,
+    const std::vector<int>& districtOf,
+    int D,
+    EdgeList& partitionedEdges,
+    std::vector<int>& bucketStart
+) {
+    // Bucket d (0..D) holds edges inside district d, bucket D + 1 holds edges between districts
+    // (district 0 collects nodes that BFS did not reach)
+    int interBucket = D + 1;
+    bucketStart.assign(D + 3, 0);
+
+    auto bucketOf = [&](const std::tuple<int, int, int>& edge) {
+        int n1District = districtOf[std::get<0>(edge)];
+        int n2District = districtOf[std::get<1>(edge)];
+        return n1District == n2District ? n1District : interBucket;
+    };
+
+    // Count edges in each bucket
+    for (size_t i = 0; i < edges.size(); i++) {
+        bucketStart[bucketOf(edges[i]) + 1]++;
+    }
+    for (int b = 1; b < D + 3; b++) {
+        bucketStart[b] += bucketStart[b - 1];
+    }
+
+    // Scatter edges to their buckets
+    std::vector<int> position(bucketStart.begin(), bucketStart.end() - 1);
+    partitionedEdges.resize(edges.size());
+    for (size_t i = 0; i < edges.size(); i++) {
+        partitionedEdges[position[bucketOf(edges[i])]++] = edges[i];
+    }
+}
+
+long long kruskalOnRange(
+    EdgeList::iterator begin,
+    EdgeList::iterator end,
+    const std::vector<int>& localId,
+    int numNodes
+) {
+    long long weight = 0;
+    DisjointSet ds(numNodes);
 
     // Sort edges
-    std::sort(edges.begin(), edges.end(),
+    std::sort(begin, end,
         [](const std::tuple<int,int,int>& a, const std::tuple<int,int,int>& b) {
             return std::get<2>(a) < std::get<2>(b);
         }
     );
 
     // Use Kruskal's algorithm
-    for (size_t i = 0; i < edges.size(); i++) {
+    for (auto it = begin; it != end; ++it) {
         int n1, n2, cost;
-        std::tie(n1, n2, cost) = edges[i];
+        std::tie(n1, n2, cost) = *it;
+        n1 = localId[n1];
+        n2 = localId[n2];
 
-        int n1District = districtOf[n1];
-        int n2District = districtOf[n2];
+        if (ds.find(n1) != ds.find(n2)) {
+            ds.unionSets(n1, n2);
+            weight = weight + cost;
+        }
+    }
+
+    return weight;
+}
+
+long long primOnRange(
+    EdgeList::const_iterator begin,
+    EdgeList::const_iterator end,
+    const std::vector<int>& localId,
+    int numNodes
+) {
+    // Nodes 0..numNodes as in DisjointSet, the weight matrix keeps the lightest edge of every pair (INT_MAX for none)
+    const SimdKernels& kernels = SimdKernels::get();
+    int n = numNodes + 1;
+    std::vector<int, LargeArrayAllocator<int>> weight((size_t)n * n, INT_MAX);
+    for (auto it = begin; it != end; ++it) {
+        int n1, n2, cost;
+        std::tie(n1, n2, cost) = *it;
+        n1 = localId[n1];
+        n2 = localId[n2];
+        if (n1 != n2) {
+            int& w = weight[(size_t)n1 * n + n2];
+            w = std::min(w, cost);
+            weight[(size_t)n2 * n + n1] = w;
+        }
+    }
+
+    // key is the lightest edge from the tree to every node, blocked keeps keys of tree nodes at INT_MAX
+    std::vector<int> key(n, INT_MAX);
+    std::vector<int> blocked(n, INT_MIN);
+    long long totalWeight = 0;
+    int firstOutside = 0;
+    int node = 0;
+    for (int added = 1; ; added++) {
+        blocked[node] = INT_MAX;
+        key[node] = INT_MAX;
+        if (added == n) {
+            break;
+        }
 
-        if (n1District != n2District) {
-            // Nodes are in different district graphs
-            if (dsDistrictNodes.find(n1District) != dsDistrictNodes.find(n2District)) {
-                dsDistrictNodes.unionSets(n1District, n2District);
-                minWeight = minWeight + cost;
+        int minKey = kernels.relaxRow(key.data(), weight.data() + (size_t)node * n, blocked.data(), n);
+        if (minKey == INT_MAX) {
+            // Nothing else is connected to this tree, start the next one, so the result is a spanning forest as with Kruskal
+            while (blocked[firstOutside] == INT_MAX) {
+                firstOutside++;
             }
+            node = firstOutside;
+        } else {
+            node = kernels.findValue(key.data(), n, minKey);
+            totalWeight = totalWeight + minKey;
+        }
+    }
+
+    return totalWeight;
+}
 
+long long computeMinWeight(const EdgeList& edges, const std::vector<int>& districtOf, int T, int D, double denseRatio) {
+    // Intra-district edges only touch nodes of their own district and inter-district edges
+    // only touch district nodes, so every district (and the district graph) is an independent MST
+    EdgeList partitionedEdges;
+    std::vector<int> bucketStart;
+    partitionEdgesByDistrict(edges, districtOf, D, partitionedEdges, bucketStart);
+
+    // Number nodes inside each district from 0 so every district gets its own small union-find
+    std::vector<int> localId(T + 1);
+    std::vector<int> districtSize(D + 1, 0);
+    for (int i = 1; i <= T; i++) {
+        localId[i] = districtSize[districtOf[i]]++;
+    }
+
+    // Task 0 is the district graph (its edges are looked up by district ids), task d + 1 is district d,
+    // a part with at least denseRatio * nodes^2 edges runs Prim over a weight matrix in O(nodes^2) instead of sorting its edges.
+    // Prim marks missing edges and tree nodes with INT_MAX, so a part with an edge of that cost is always sorted
+    std::vector<long long> partialWeight(D + 2, 0);
+    runTasksInParallel(D + 2, [&](int task) {
+        int bucket = task == 0 ? D + 1 : task - 1;
+        EdgeList::iterator begin = partitionedEdges.begin() + bucketStart[bucket];
+        EdgeList::iterator end = partitionedEdges.begin() + bucketStart[bucket + 1];
+        const std::vector<int>& ids = task == 0 ? districtOf : localId;
+        int numNodes = task == 0 ? D : districtSize[bucket];
+        bool dense = end - begin >= denseRatio * ((double)numNodes * numNodes)
+            && std::none_of(begin, end, [](const std::tuple<int, int, int>& edge) { return std::get<2>(edge) == INT_MAX; });
+        if (dense) {
+            partialWeight[task] = primOnRange(begin, end, ids, numNodes);
         } else {
-            // Nodes are in the same district graph
-            if (dsNodesInDistrict.find(n1) != dsNodesInDistrict.find(n2)) {
-                dsNodesInDistrict.unionSets(n1, n2);
-                minWeight = minWeight + cost;
-            }
+            partialWeight[task] = kruskalOnRange(begin, end, ids, numNodes);
         }
+    });
+
+    long long minWeight = 0;
+    for (size_t i = 0; i < partialWeight.size(); i++) {
+        minWeight = minWeight + partialWeight[i];
+    }
+
+    return minWeight;
+}
+
+long long computeDistrictsAndWeight(const EdgeList& edges, std::vector<int>& districtOf, int T, int D, double denseRatio, PhaseReport& report, FlatAdjacencyList* countedAdjacencyList = nullptr) {
+    // Convert graph from inputs triplets to adjacency list for BFS, degrees may be already counted while loading
+    report.start("adjacency");
+    FlatAdjacencyList adjacencyList;
+    if (countedAdjacencyList != nullptr) {
+        std::swap(adjacencyList, *countedAdjacencyList);
+        fillAdjacencyList(edges, adjacencyList, T);
+    } else {
+        createAdjacencyList(edges, adjacencyList, T);
     }
+    report.stop();
+
+    // BFS
+    report.start("bfs");
+    runBfsSearch(districtOf, T, D, adjacencyList);
+    report.stop();
+
+    // MST
+    report.start("mst");
+    long long minWeight = computeMinWeight(edges, districtOf, T, D, denseRatio);
+    report.stop();
 
     return minWeight;
 }
 
+struct EdgeUpdate {
+    char op;    // '+' insert, '-' delete, '=' change cost
+    int n1, n2, cost;
+};
+
+// Network under batches of edge updates, keeps the BFS districts and one minimum spanning forest of all buckets.
+// Forest updates walk whole trees: inserting an edge costs O(size of its tree) and deleting a forest edge
+// O(vertices and incident edges of the smaller side), so with a single district an update is O(T + R) at worst
+class DynamicNetwork {
+private:
+    struct Edge {
+        int n1, n2, cost;
+        bool alive;
+        bool inForest;
+        bool detached;      // being moved to another bucket, not a replacement candidate meanwhile
+    };
+
+    int T, D;
+    std::vector<Edge> edges;
+    int numAlive;
+    // Alive edges of every node by increasing id, the order in which a fresh BFS scans its neighbours,
+    // deletions and cost changes go to the first alive edge of the pair found here
+    std::vector<std::vector<int>> incidentEdges;
+
+    // BFS tree. A node is discovered by its first neighbour one level up in queue order, and queue order is
+    // (level, queue order of the parent, id of the first edge from the parent), so parents can be repaired
+    // level by level and only below the nodes whose place in the queue changed
+    std::vector<int> districtOf;
+    std::vector<int> levelOf;
+    std::vector<int> parentOf;
+    std::vector<int> parentEdgeOf;
+
+    // Minimum spanning forest of all buckets together: an edge inside a district connects its nodes
+    // (vertices 0..T), an edge between districts connects the districts (vertices T + 1..T + D)
+    std::vector<std::vector<int>> forestEdgesOf;
+    // Edges between districts of every district, entries that are no longer such edges are dropped when scanned
+    std::vector<std::vector<int>> interEdgesOf;
+    long long forestWeight;
+
+    // A mark is set when it equals the current stamp, so nothing has to be cleared between searches and batches
+    std::vector<int> searchMark;
+    std::vector<int> viaEdge;
+    int searchStamp;
+    std::vector<int> levelChangedAt;
+    std::vector<int> queuedAt;
+    std::vector<int> keyChangedAt;
+    int batchStamp;
+
+    static int otherEnd(const Edge& edge, int node) {
+        return edge.n1 == node ? edge.n2 : edge.n1;
+    }
+
+    bool isInter(const Edge& edge) const {
+        return districtOf[edge.n1] != districtOf[edge.n2];
+    }
+
+    void forestVertices(const Edge& edge, int& u, int& v) const {
+        if (isInter(edge)) {
+            u = T + districtOf[edge.n1];
+            v = T + districtOf[edge.n2];
+        } else {
+            u = edge.n1;
+            v = edge.n2;
+        }
+    }
+
+    int findEdge(int n1, int n2) const {
+        // First alive edge between the two nodes in input order, searched from the node with fewer edges
+        if (incidentEdges[n2].size() < incidentEdges[n1].size()) {
+            std::swap(n1, n2);
+        }
+        for (size_t i = 0; i < incidentEdges[n1].size(); i++) {
+            if (otherEnd(edges[incidentEdges[n1][i]], n1) == n2) {
+                return incidentEdges[n1][i];
+            }
+        }
+        return -1;
+    }
+
+    int forestNeighbour(int edgeId, int vertex) const {
+        int u, v;
+        forestVertices(edges[edgeId], u, v);
+        return u == vertex ? v : u;
+    }
+
+    void link(int edgeId) {
+        int u, v;
+        forestVertices(edges[edgeId], u, v);
+        edges[edgeId].inForest = true;
+        forestEdgesOf[u].push_back(edgeId);
+        forestEdgesOf[v].push_back(edgeId);
+        forestWeight = forestWeight + edges[edgeId].cost;
+    }
+
+    void cut(int edgeId) {
+        int u, v;
+        forestVertices(edges[edgeId], u, v);
+        for (int vertex : {u, v}) {
+            std::vector<int>& ids = forestEdgesOf[vertex];
+            *std::find(ids.begin(), ids.end(), edgeId) = ids.back();
+            ids.pop_back();
+        }
+        edges[edgeId].inForest = false;
+        forestWeight = forestWeight - edges[edgeId].cost;
+    }
+
+    int findHeaviestOnPath(int from, int to) {
+        // Walks the forest from one vertex, returns the most expensive edge on the path to the other (-1 for none)
+        searchStamp++;
+        searchMark[from] = searchStamp;
+        std::vector<int> stack(1, from);
+        while (!stack.empty() && searchMark[to] != searchStamp) {
+            int vertex = stack.back();
+            stack.pop_back();
+            for (size_t i = 0; i < forestEdgesOf[vertex].size(); i++) {
+                int edgeId = forestEdgesOf[vertex][i];
+                int next = forestNeighbour(edgeId, vertex);
+                if (searchMark[next] != searchStamp) {
+                    searchMark[next] = searchStamp;
+                    viaEdge[next] = edgeId;
+                    stack.push_back(next);
+                }
+            }
+        }
+        if (searchMark[to] != searchStamp) {
+            return -1;
+        }
+
+        int heaviest = -1;
+        for (int vertex = to; vertex != from; vertex = forestNeighbour(viaEdge[vertex], vertex)) {
+            if (heaviest == -1 || edges[viaEdge[vertex]].cost > edges[heaviest].cost) {
+                heaviest = viaEdge[vertex];
+            }
+        }
+        return heaviest;
+    }
+
+    void addToForest(int edgeId) {
+        // A non-forest edge joins two trees, or replaces the most expensive edge of the cycle it closes
+        int u, v;
+        forestVertices(edges[edgeId], u, v);
+        if (u == v) {
+            return;
+        }
+        int heaviest = findHeaviestOnPath(u, v);
+        if (heaviest == -1) {
+            link(edgeId);
+        } else if (edges[heaviest].cost > edges[edgeId].cost) {
+            cut(heaviest);
+            link(edgeId);
+        }
+    }
+
+    void insertEdge(int edgeId) {
+        const Edge& edge = edges[edgeId];
+        if (isInter(edge)) {
+            interEdgesOf[districtOf[edge.n1]].push_back(edgeId);
+            interEdgesOf[districtOf[edge.n2]].push_back(edgeId);
+        }
+        addToForest(edgeId);
+    }
+
+    bool isCandidate(int edgeId) const {
+        const Edge& edge = edges[edgeId];
+        return edge.alive && !edge.inForest && !edge.detached;
+    }
+
+    void removeFromForest(int edgeId) {
+        // Cut the edge and reconnect its two trees by the cheapest edge between them. Both trees are walked
+        // alternately, so only the smaller one is walked completely and its edges are the ones scanned
+        int u, v;
+        forestVertices(edges[edgeId], u, v);
+        cut(edgeId);
+
+        searchStamp += 2;
+        int sideStamp[2] = {searchStamp - 1, searchStamp};
+        std::vector<int> side[2] = {std::vector<int>(1, u), std::vector<int>(1, v)};
+        size_t walked[2] = {0, 0};
+        searchMark[u] = sideStamp[0];
+        searchMark[v] = sideStamp[1];
+        int smaller = -1;
+        while (smaller == -1) {
+            for (int s = 0; s < 2 && smaller == -1; s++) {
+                if (walked[s] == side[s].size()) {
+                    smaller = s;
+                    break;
+                }
+                int vertex = side[s][walked[s]++];
+                for (size_t i = 0; i < forestEdgesOf[vertex].size(); i++) {
+                    int next = forestNeighbour(forestEdgesOf[vertex][i], vertex);
+                    if (searchMark[next] != sideStamp[s]) {
+                        searchMark[next] = sideStamp[s];
+                        side[s].push_back(next);
+                    }
+                }
+            }
+        }
+
+        int replacement = -1;
+        for (size_t i = 0; i < side[smaller].size(); i++) {
+            int vertex = side[smaller][i];
+            if (vertex <= T) {
+                for (size_t j = 0; j < incidentEdges[vertex].size(); j++) {
+                    int candidate = incidentEdges[vertex][j];
+                    const Edge& edge = edges[candidate];
+                    if (isCandidate(candidate) && !isInter(edge) && searchMark[otherEnd(edge, vertex)] != sideStamp[smaller]
+                        && (replacement == -1 || edge.cost < edges[replacement].cost)) {
+                        replacement = candidate;
+                    }
+                }
+                continue;
+            }
+
+            std::vector<int>& ids = interEdgesOf[vertex - T];
+            size_t kept = 0;
+            for (size_t j = 0; j < ids.size(); j++) {
+                const Edge& edge = edges[ids[j]];
+                if (!edge.alive || !isInter(edge) || (T + districtOf[edge.n1] != vertex && T + districtOf[edge.n2] != vertex)) {
+                    continue;
+                }
+                ids[kept++] = ids[j];
+                if (isCandidate(ids[j]) && searchMark[forestNeighbour(ids[j], vertex)] != sideStamp[smaller]
+                    && (replacement == -1 || edge.cost < edges[replacement].cost)) {
+                    replacement = ids[j];
+                }
+            }
+            ids.resize(kept);
+        }
+
+        if (replacement != -1) {
+            link(replacement);
+        }
+    }
+
+    void rebuildForest() {
+        // Kruskal over all alive edges, used at the start and when too many edges change bucket at once
+        forestEdgesOf.assign(T + D + 1, std::vector<int>());
+        interEdgesOf.assign(D + 1, std::vector<int>());
+        forestWeight = 0;
+        std::vector<int> ids;
+        ids.reserve(numAlive);
+        for (size_t i = 0; i < edges.size(); i++) {
+            edges[i].inForest = false;
+            if (edges[i].alive) {
+                ids.push_back(i);
+                if (isInter(edges[i])) {
+                    interEdgesOf[districtOf[edges[i].n1]].push_back(i);
+                    interEdgesOf[districtOf[edges[i].n2]].push_back(i);
+                }
+            }
+        }
+        std::sort(ids.begin(), ids.end(), [&](int a, int b) {
+            return edges[a].cost < edges[b].cost;
+        });
+
+        DisjointSet ds(T + D);
+        for (size_t i = 0; i < ids.size(); i++) {
+            int u, v;
+            forestVertices(edges[ids[i]], u, v);
+            if (ds.find(u) != ds.find(v)) {
+                ds.unionSets(u, v);
+                link(ids[i]);
+            }
+        }
+    }
+
+    void markLevelChanged(int node, std::vector<int>& seeds) {
+        // The node and all its neighbours may have to pick another parent
+        levelChangedAt[node] = batchStamp;
+        seeds.push_back(node);
+        for (size_t i = 0; i < incidentEdges[node].size(); i++) {
+            seeds.push_back(otherEnd(edges[incidentEdges[node][i]], node));
+        }
+    }
+
+    void repairLevelsAfterInsert(int n1, int n2, std::vector<int>& seeds) {
+        // Levels can only drop, BFS from the endpoint that got closer
+        if (levelOf[n1] == -1 || (levelOf[n2] != -1 && levelOf[n2] < levelOf[n1])) {
+            std::swap(n1, n2);
+        }
+        if (levelOf[n1] == -1 || (levelOf[n2] != -1 && levelOf[n2] <= levelOf[n1] + 1)) {
+            return;
+        }
+
+        levelOf[n2] = levelOf[n1] + 1;
+        std::vector<int> queue(1, n2);
+        for (size_t head = 0; head < queue.size(); head++) {
+            int node = queue[head];
+            markLevelChanged(node, seeds);
+            for (size_t i = 0; i < incidentEdges[node].size(); i++) {
+                int neighbour = otherEnd(edges[incidentEdges[node][i]], node);
+                if (levelOf[neighbour] == -1 || levelOf[neighbour] > levelOf[node] + 1) {
+                    levelOf[neighbour] = levelOf[node] + 1;
+                    queue.push_back(neighbour);
+                }
+            }
+        }
+    }
+
+    bool hasSupport(int node) const {
+        // Whether some neighbour one level up keeps its level (nodes losing theirs carry the search mark)
+        for (size_t i = 0; i < incidentEdges[node].size(); i++) {
+            int neighbour = otherEnd(edges[incidentEdges[node][i]], node);
+            if (levelOf[neighbour] == levelOf[node] - 1 && searchMark[neighbour] != searchStamp) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void repairLevelsAfterDelete(int n1, int n2, std::vector<int>& seeds) {
+        // Levels can only grow, and only for nodes below the lower endpoint that lost every neighbour one level up
+        if (levelOf[n1] == -1 || std::abs(levelOf[n1] - levelOf[n2]) != 1) {
+            return;
+        }
+        int child = levelOf[n1] > levelOf[n2] ? n1 : n2;
+        searchStamp++;
+        if (hasSupport(child)) {
+            return;
+        }
+
+        // Found level by level, so all nodes losing their level one level up are known before a node is checked
+        std::vector<int> lost(1, child);
+        searchMark[child] = searchStamp;
+        for (size_t head = 0; head < lost.size(); head++) {
+            int node = lost[head];
+            for (size_t i = 0; i < incidentEdges[node].size(); i++) {
+                int neighbour = otherEnd(edges[incidentEdges[node][i]], node);
+                if (levelOf[neighbour] == levelOf[node] + 1 && searchMark[neighbour] != searchStamp && !hasSupport(neighbour)) {
+                    searchMark[neighbour] = searchStamp;
+                    lost.push_back(neighbour);
+                }
+            }
+        }
+
+        // New levels grow from the neighbours that kept theirs, with unit weights
+        std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<std::pair<int, int>>> queue;
+        for (size_t i = 0; i < lost.size(); i++) {
+            int node = lost[i];
+            for (size_t j = 0; j < incidentEdges[node].size(); j++) {
+                int neighbour = otherEnd(edges[incidentEdges[node][j]], node);
+                if (searchMark[neighbour] != searchStamp && levelOf[neighbour] != -1) {
+                    queue.emplace(levelOf[neighbour] + 1, node);
+                }
+            }
+        }
+        for (size_t i = 0; i < lost.size(); i++) {
+            levelOf[lost[i]] = INT_MAX;
+        }
+        while (!queue.empty()) {
+            int level = queue.top().first;
+            int node = queue.top().second;
+            queue.pop();
+            if (level >= levelOf[node]) {
+                continue;
+            }
+            levelOf[node] = level;
+            for (size_t i = 0; i < incidentEdges[node].size(); i++) {
+                int neighbour = otherEnd(edges[incidentEdges[node][i]], node);
+                if (searchMark[neighbour] == searchStamp && levelOf[neighbour] > level + 1) {
+                    queue.emplace(level + 1, neighbour);
+                }
+            }
+        }
+        for (size_t i = 0; i < lost.size(); i++) {
+            if (levelOf[lost[i]] == INT_MAX) {
+                levelOf[lost[i]] = -1;
+            }
+            markLevelChanged(lost[i], seeds);
+        }
+    }
+
+    bool isQueuedBefore(int u, int w) const {
+        // Queue order of two different nodes on the same level, decided where their paths to the districts meet
+        while (parentOf[u] != parentOf[w]) {
+            u = parentOf[u];
+            w = parentOf[w];
+        }
+        return parentOf[u] == -1 ? u < w : parentEdgeOf[u] < parentEdgeOf[w];
+    }
+
+    void repairTree(const std::vector<int>& seeds, std::vector<std::pair<int, int>>& moved) {
+        // Picks parents again level by level, starting from the seeds. A node whose place in the queue changed
+        // passes the check on to its neighbours one level down. Returns nodes that changed district with the old one
+        std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<std::pair<int, int>>> queue;
+        for (size_t i = 0; i < seeds.size(); i++) {
+            if (queuedAt[seeds[i]] != batchStamp) {
+                queuedAt[seeds[i]] = batchStamp;
+                queue.emplace(levelOf[seeds[i]], seeds[i]);
+            }
+        }
+
+        while (!queue.empty()) {
+            int node = queue.top().second;
+            queue.pop();
+            int level = levelOf[node];
+
+            int parent = -1;
+            int parentEdge = -1;
+            for (size_t i = 0; i < incidentEdges[node].size() && level > 0; i++) {
+                int neighbour = otherEnd(edges[incidentEdges[node][i]], node);
+                if (levelOf[neighbour] == level - 1 && (parent == -1 || (neighbour != parent && isQueuedBefore(neighbour, parent)))) {
+                    parent = neighbour;
+                    parentEdge = incidentEdges[node][i];
+                }
+            }
+            if (levelChangedAt[node] != batchStamp && parent == parentOf[node] && parentEdge == parentEdgeOf[node]
+                && (parent == -1 || keyChangedAt[parent] != batchStamp)) {
+                continue;
+            }
+
+            keyChangedAt[node] = batchStamp;
+            parentOf[node] = parent;
+            parentEdgeOf[node] = parentEdge;
+            int district = level == 0 ? node : parent != -1 ? districtOf[parent] : 0;
+            if (district != districtOf[node]) {
+                moved.emplace_back(node, districtOf[node]);
+                districtOf[node] = district;
+            }
+
+            for (size_t i = 0; i < incidentEdges[node].size() && level >= 0; i++) {
+                int neighbour = otherEnd(edges[incidentEdges[node][i]], node);
+                if (levelOf[neighbour] == level + 1 && queuedAt[neighbour] != batchStamp) {
+                    queuedAt[neighbour] = batchStamp;
+                    queue.emplace(level + 1, neighbour);
+                }
+            }
+        }
+    }
+
+    void moveEdges(const std::vector<std::pair<int, int>>& moved) {
+        // Edges of nodes that changed district may change bucket: they leave the forest under the old districts
+        // and come back under the new ones, or the whole forest is rebuilt when that is a big part of the graph
+        std::vector<int> newDistrict(moved.size());
+        std::vector<int> ids;
+        for (size_t i = 0; i < moved.size(); i++) {
+            int node = moved[i].first;
+            newDistrict[i] = districtOf[node];
+            districtOf[node] = moved[i].second;
+            for (size_t j = 0; j < incidentEdges[node].size(); j++) {
+                int edgeId = incidentEdges[node][j];
+                if (!edges[edgeId].detached) {
+                    edges[edgeId].detached = true;
+                    ids.push_back(edgeId);
+                }
+            }
+        }
+
+        bool rebuild = ids.size() * 8 > (size_t)numAlive;
+        for (size_t i = 0; i < ids.size() && !rebuild; i++) {
+            if (edges[ids[i]].inForest) {
+                removeFromForest(ids[i]);
+            }
+        }
+        for (size_t i = 0; i < moved.size(); i++) {
+            districtOf[moved[i].first] = newDistrict[i];
+        }
+        for (size_t i = 0; i < ids.size(); i++) {
+            edges[ids[i]].detached = false;
+        }
+        if (rebuild) {
+            rebuildForest();
+            return;
+        }
+        for (size_t i = 0; i < ids.size(); i++) {
+            insertEdge(ids[i]);
+        }
+    }
+
+public:
+    DynamicNetwork(const EdgeList& inputEdges, int T, int D) : T(T), D(D) {
+        FlatAdjacencyList adjacencyList;
+        createAdjacencyList(inputEdges, adjacencyList, T);
+
+        edges.reserve(inputEdges.size());
+        incidentEdges.assign(T + 1, std::vector<int>());
+        for (int i = 1; i <= T; i++) {
+            incidentEdges[i].reserve(adjacencyList.degree(i));
+        }
+        for (size_t i = 0; i < inputEdges.size(); i++) {
+            int n1, n2, cost;
+            std::tie(n1, n2, cost) = inputEdges[i];
+            incidentEdges[n1].push_back(edges.size());
+            if (n2 != n1) {
+                incidentEdges[n2].push_back(edges.size());
+            }
+            edges.push_back({n1, n2, cost, true, false, false});
+        }
+        numAlive = edges.size();
+
+        districtOf.assign(T + 1, 0);
+        runBfsSearch(districtOf, T, D, adjacencyList, &levelOf, &parentOf);
+        parentEdgeOf.assign(T + 1, -1);
+        for (int i = 1; i <= T; i++) {
+            for (size_t j = 0; j < incidentEdges[i].size() && parentOf[i] != -1 && parentEdgeOf[i] == -1; j++) {
+                if (otherEnd(edges[incidentEdges[i][j]], i) == parentOf[i]) {
+                    parentEdgeOf[i] = incidentEdges[i][j];
+                }
+            }
+        }
+
+        searchMark.assign(T + D + 1, 0);
+        viaEdge.assign(T + D + 1, -1);
+        searchStamp = 0;
+        levelChangedAt.assign(T + 1, 0);
+        queuedAt.assign(T + 1, 0);
+        keyChangedAt.assign(T + 1, 0);
+        batchStamp = 0;
+
+        rebuildForest();
+    }
+
+    long long applyBatch(const std::vector<EdgeUpdate>& batch) {
+        // Updates go into the forest right away under the current districts, the BFS tree is repaired after
+        // the whole batch and only the edges of nodes that changed district are moved
+        batchStamp++;
+        std::vector<int> seeds;
+
+        for (size_t i = 0; i < batch.size(); i++) {
+            const EdgeUpdate& update = batch[i];
+
+            if (update.op == '+') {
+                int edgeId = edges.size();
+                edges.push_back({update.n1, update.n2, update.cost, true, false, false});
+                incidentEdges[update.n1].push_back(edgeId);
+                if (update.n2 != update.n1) {
+                    incidentEdges[update.n2].push_back(edgeId);
+                }
+                numAlive++;
+                insertEdge(edgeId);
+                repairLevelsAfterInsert(update.n1, update.n2, seeds);
+                seeds.push_back(update.n1);
+                seeds.push_back(update.n2);
+                continue;
+            }
+
+            int edgeId = findEdge(update.n1, update.n2);
+            if (edgeId == -1) {
+                // Nothing to delete or change
+                continue;
+            }
+            Edge& edge = edges[edgeId];
+
+            if (update.op == '-') {
+                edge.alive = false;
+                for (int node : {edge.n1, edge.n2}) {
+                    std::vector<int>& ids = incidentEdges[node];
+                    std::vector<int>::iterator it = std::find(ids.begin(), ids.end(), edgeId);
+                    if (it != ids.end()) {
+                        ids.erase(it);
+                    }
+                }
+                numAlive--;
+                if (edge.inForest) {
+                    removeFromForest(edgeId);
+                }
+                repairLevelsAfterDelete(edge.n1, edge.n2, seeds);
+                seeds.push_back(edge.n1);
+                seeds.push_back(edge.n2);
+            } else if (edge.inForest) {
+                // Cheaper forest edge stays in the forest, a more expensive one competes with its replacements
+                int oldCost = edge.cost;
+                edge.cost = update.cost;
+                if (update.cost <= oldCost) {
+                    forestWeight = forestWeight - (oldCost - update.cost);
+                } else {
+                    forestWeight = forestWeight + (update.cost - oldCost);
+                    removeFromForest(edgeId);
+                }
+            } else {
+                // More expensive non-forest edge stays out of the forest, a cheaper one may close a better cycle
+                bool cheaper = update.cost < edge.cost;
+                edge.cost = update.cost;
+                if (cheaper) {
+                    addToForest(edgeId);
+                }
+            }
+        }
+
+        std::vector<std::pair<int, int>> moved;
+        repairTree(seeds, moved);
+        moveEdges(moved);
+
+        return forestWeight;
+    }
+};
+
+void loadEdgeUpdates(std::istream& input, std::vector<EdgeUpdate>& batch, int K) {
+    for (int i = 0; i < K; i++) {
+        EdgeUpdate update = {0, 0, 0, 0};
+        input >> update.op >> update.n1 >> update.n2;
+        if (update.op != '-') {
+            input >> update.cost;
+        }
+        batch.push_back(update);
+    }
+}
+
 /* MAIN */
 int main() {
     // T - number of nodes (cities)
@@ -176,25 +1961,104 @@ int main() {
     std::cin >> T >> D >> R;
 
     // Define vector for storing edges
-    std::vector<std::tuple<int, int, int>> edges;
+    EdgeList edges;
     edges.reserve(R);
 
-    std::vector<std::vector<int>> adjacencyList(T + 1);
+    PhaseReport report(std::getenv("PAL_REPORT") != nullptr);
 
-    // Load edges from input to the vector
-    loadInputEdges(edges, R);
+    // Optionally relabel nodes, so the traversal touches memory in order
+    const char* nodeOrder = std::getenv("PAL_REORDER");
+    bool reorder = nodeOrder != nullptr && *nodeOrder != '\0';
 
-    // Convert graph from inputs triplets to adjacency list for BFS
-    createAdjacencyList(edges, adjacencyList);
+    // Parts of the graph with at least PAL_DENSE_RATIO * nodes^2 edges get the dense MST. Prim overtakes
+    // sorting at about 0.06 but is within noise of it up to 0.08, the default 0.1 (a fifth of all node pairs)
+    // leaves that margin, as the weight matrix takes nodes^2 ints on top of the edges
+    double denseRatio = 0.1;
+    const char* denseRatioEnv = std::getenv("PAL_DENSE_RATIO");
+    if (denseRatioEnv != nullptr) {
+        char* end;
+        double value = std::strtod(denseRatioEnv, &end);
+        if (end != denseRatioEnv && *end == '\0' && std::isfinite(value) && value >= 0) {
+            denseRatio = value;
+        } else {
+            std::cerr << "Invalid dense ratio, using " << denseRatio << ": " << denseRatioEnv << std::endl;
+        }
+    }
+
+    // Load edges from input to the vector, either in parallel chunks or streamed while degrees are counted
+    // (relabelled edges need their degrees counted again, so streaming is used only without reordering)
+    std::string rest;
+    FlatAdjacencyList countedAdjacencyList;
+    bool pipeline = std::getenv("PAL_PIPELINE") != nullptr && !reorder;
+    if (pipeline) {
+        report.start("parse+count");
+        streamInputEdges(edges, R, countedAdjacencyList, T, rest);
+    } else {
+        report.start("parse");
+        loadInputEdges(edges, R, rest);
+    }
+    report.stop();
+
+    std::vector<int> newId;
+    if (reorder) {
+        report.start("reorder");
+        FlatAdjacencyList adjacencyList;
+        createAdjacencyList(edges, adjacencyList, T);
+        newId = computeNodeOrder(adjacencyList, T, D, nodeOrder);
+        if (!newId.empty()) {
+            relabelEdges(edges, newId);
+        }
+        report.stop();
+    }
 
-    // BFS
     std::vector<int> districtOf(T + 1);
-    runBfsSearch(districtOf, T, D, adjacencyList);
+    long long minWeight = computeDistrictsAndWeight(edges, districtOf, T, D, denseRatio, report, pipeline ? &countedAdjacencyList : nullptr);
 
-    // MST
-    int minWeight = computeMinWeight(edges, districtOf, T, D);
+    if (!newId.empty()) {
+        // Map edges back to the original ids, updates name nodes by them and the weight does not depend on ids
+        std::vector<int> oldId(T + 1);
+        for (int i = 1; i <= T; i++) {
+            oldId[newId[i]] = i;
+        }
+        relabelEdges(edges, oldId);
+
+        if (report.isEnabled()) {
+            // Time the traversal again in both orders (with warm allocator and caches) to see what reordering saved
+            std::vector<int> districtOfTiming(T + 1);
+            // Inner phases go to their own report, starting them would reset the outer timer
+            PhaseReport timing(false);
+            PhaseReport phases(false);
+            timing.start("original");
+            computeDistrictsAndWeight(edges, districtOfTiming, T, D, denseRatio, phases);
+            double originalMs = timing.stop();
+
+            relabelEdges(edges, newId);
+            timing.start("reordered");
+            computeDistrictsAndWeight(edges, districtOfTiming, T, D, denseRatio, phases);
+            double reorderedMs = timing.stop();
+            relabelEdges(edges, oldId);
+
+            report.note("reorder " + std::string(nodeOrder) + ": spent " + std::to_string(report.total("reorder"))
+                + " ms, saved " + std::to_string(originalMs - reorderedMs) + " ms per traversal (" + std::to_string(originalMs)
+                + " ms original order, " + std::to_string(reorderedMs) + " ms reordered)");
+        }
+    }
     
     std::cout << minWeight << std::endl; 
+
+    // Optional batches of edge updates, each one is K followed by K lines "+ n1 n2 cost", "- n1 n2" or "= n1 n2 cost"
+    std::istringstream updates(rest);
+    int K;
+    if (updates >> K) {
+        DynamicNetwork network(edges, T, D);
+        do {
+            std::vector<EdgeUpdate> batch;
+            loadEdgeUpdates(updates, batch, K);
+            std::cout << network.applyBatch(batch) << std::endl;
+        } while (updates >> K);
+    }
+
+    report.print();
     
     return 0;
 }
@@ -1,9 +1,762 @@
 #include <iostream>
 #include <vector>
-#include <set>
 #include <tuple>
 #include <stack>
-#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Placement of big arrays, read once from PAL_HUGEPAGES (thp, hugetlb, off) and PAL_NUMA (interleave, firsttouch)
+struct LargeArrayConfig {
+    bool hugePages = true;
+    bool hugetlb = false;
+    bool interleave = false;
+    bool firstTouch = false;
+    unsigned long nodeMask = 0;
+    std::atomic<long long> hugePageBytes{0};
+    std::atomic<long long> hugetlbBytes{0};
+
+    LargeArrayConfig() {
+        const char* hugePagesEnv = std::getenv("PAL_HUGEPAGES");
+        if (hugePagesEnv != nullptr) {
+            hugePages = std::string(hugePagesEnv) != "off";
+            hugetlb = std::string(hugePagesEnv) == "hugetlb";
+        }
+
+        const char* numaEnv = std::getenv("PAL_NUMA");
+        if (numaEnv != nullptr) {
+            interleave = std::string(numaEnv) == "interleave";
+            firstTouch = std::string(numaEnv) == "firsttouch";
+        }
+
+        // Online NUMA nodes, e.g. "0-1" or "0,2", without libnuma
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string ranges;
+        if (online >> ranges) {
+            std::stringstream stream(ranges);
+            std::string range;
+            while (std::getline(stream, range, ',')) {
+                size_t dash = range.find('-');
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int node = first; node <= last && node < 64; node++) {
+                    nodeMask |= 1UL << node;
+                }
+            }
+        }
+    }
+
+    int numNodes() const {
+        return __builtin_popcountl(nodeMask);
+    }
+
+    static LargeArrayConfig& get() {
+        static LargeArrayConfig config;
+        return config;
+    }
+};
+
+// Allocator for the big flat arrays: 2 MiB aligned mappings backed by huge pages and placed across NUMA nodes
+template <typename T>
+class LargeArrayAllocator {
+private:
+    static const size_t hugePageSize = 2 << 20;
+
+    static size_t mappedSize(size_t bytes) {
+        return (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+    }
+
+public:
+    typedef T value_type;
+
+    LargeArrayAllocator() = default;
+
+    template <typename U>
+    LargeArrayAllocator(const LargeArrayAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < hugePageSize) {
+            // Small arrays are not worth a mapping of their own
+            return static_cast<T*>(::operator new(bytes));
+        }
+
+        LargeArrayConfig& config = LargeArrayConfig::get();
+        size_t size = mappedSize(bytes);
+        void* memory = MAP_FAILED;
+
+        if (config.hugetlb) {
+            // Explicit huge pages from hugetlbfs, falls back to normal pages when none are reserved
+            memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED) {
+                config.hugetlbBytes += size;
+            }
+        }
+        if (memory == MAP_FAILED) {
+            memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            if (config.hugePages && madvise(memory, size, MADV_HUGEPAGE) == 0) {
+                config.hugePageBytes += size;
+            }
+        }
+
+        if (config.interleave && config.numNodes() > 1) {
+            // Spread pages round-robin over all nodes, ignore failure (e.g. seccomp) and keep the default policy
+            const int mpolInterleave = 3;
+            syscall(SYS_mbind, memory, size, mpolInterleave, &config.nodeMask, sizeof(config.nodeMask) * 8 + 1, 0);
+        }
+
+        if (config.firstTouch) {
+            // Best-effort pre-fault: zero the pages from several threads, so they are not all placed on the node of
+            // the allocating thread. The threads are not pinned and are not the ones that traverse the array later,
+            // so where each part ends up is up to the scheduler
+            int numThreads = std::max(1u, std::thread::hardware_concurrency());
+            size_t chunk = mappedSize((size + numThreads - 1) / numThreads);
+            std::vector<std::thread> threads;
+            for (size_t from = 0; from < size; from += chunk) {
+                threads.emplace_back([=]() {
+                    std::memset(static_cast<char*>(memory) + from, 0, std::min(chunk, size - from));
+                });
+            }
+            for (size_t i = 0; i < threads.size(); i++) {
+                threads[i].join();
+            }
+        }
+
+        return static_cast<T*>(memory);
+    }
+
+    void deallocate(T* pointer, size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < hugePageSize) {
+            ::operator delete(pointer);
+            return;
+        }
+        munmap(pointer, mappedSize(bytes));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const LargeArrayAllocator<T>&, const LargeArrayAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const LargeArrayAllocator<T>&, const LargeArrayAllocator<U>&) {
+    return false;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Digit mask of 64 bytes, bit i is set when block[i] is '0' .. '9'
+__attribute__((target("sse4.2")))
+uint64_t digitMaskSse42(const char* block) {
+    // c - '0' <= 9 as unsigned bytes, min(x, 9) == x is the unsigned compare SSE lacks
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i x = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(block + 16 * i)), zero);
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, nine), x)) << (16 * i);
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+uint64_t digitMaskAvx2(const char* block) {
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+    __m256i low = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)block), zero);
+    __m256i high = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)(block + 32)), zero);
+    uint32_t lowMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(low, nine), low));
+    uint32_t highMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(high, nine), high));
+    return (uint64_t)highMask << 32 | lowMask;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+uint64_t digitMaskAvx512(const char* block) {
+    __m512i x = _mm512_sub_epi8(_mm512_loadu_si512(block), _mm512_set1_epi8('0'));
+    return _mm512_cmple_epu8_mask(x, _mm512_set1_epi8(9));
+}
+#endif
+
+// Bytes of one varint, 7 bits per byte with the high bit set on all bytes but the last one
+size_t varintSize(unsigned value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+// Reads one varint
+inline unsigned decodeVarint(const uint8_t*& it) {
+    unsigned value = 0;
+    int shift = 0;
+    while (*it & 0x80) {
+        value |= (unsigned)(*it++ & 0x7f) << shift;
+        shift += 7;
+    }
+    value |= (unsigned)*it++ << shift;
+    return value;
+}
+
+// Decodes the varint deltas of [it, end) into out as running sums from value, returns their count
+size_t decodeVarintsFrom(const uint8_t* it, const uint8_t* end, int* out, int value) {
+    int* first = out;
+    while (it != end) {
+        value += decodeVarint(it);
+        *out++ = value;
+    }
+    return out - first;
+}
+
+size_t decodeVarintsScalar(const uint8_t* it, const uint8_t* end, int* out) {
+    return decodeVarintsFrom(it, end, out, 0);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// The vector variants widen a whole block when none of its deltas is longer than a byte,
+// a block with a longer delta is decoded one by one, the wider variants finish short lists in 16-byte blocks
+__attribute__((target("sse4.2")))
+inline void decodeVarintBlocks16(const uint8_t*& it, const uint8_t* end, int*& out, int& value) {
+    while (end - it >= 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)it)) != 0) {
+            for (const uint8_t* blockEnd = it + 16; it < blockEnd; ) {
+                value += decodeVarint(it);
+                *out++ = value;
+            }
+            continue;
+        }
+        for (int i = 0; i < 16; i += 4) {
+            int32_t bytes;
+            std::memcpy(&bytes, it + i, 4);
+            __m128i x = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+            x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+            _mm_storeu_si128((__m128i*)out, _mm_add_epi32(x, _mm_set1_epi32(value)));
+            value = out[3];
+            out += 4;
+        }
+        it += 16;
+    }
+}
+
+__attribute__((target("sse4.2")))
+size_t decodeVarintsSse42(const uint8_t* it, const uint8_t* end, int* out) {
+    int* first = out;
+    int value = 0;
+    decodeVarintBlocks16(it, end, out, value);
+    return out - first + decodeVarintsFrom(it, end, out, value);
+}
+
+__attribute__((target("avx2")))
+size_t decodeVarintsAvx2(const uint8_t* it, const uint8_t* end, int* out) {
+    int* first = out;
+    int value = 0;
+    while (end - it >= 32) {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)it)) != 0) {
+            for (const uint8_t* blockEnd = it + 32; it < blockEnd; ) {
+                value += decodeVarint(it);
+                *out++ = value;
+            }
+            continue;
+        }
+        for (int i = 0; i < 32; i += 8) {
+            __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(it + i)));
+            // Prefix sums inside both 128-bit lanes, then carry the low lane total into the high lane
+            x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+            x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+            __m256i carry = _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(3));
+            x = _mm256_add_epi32(x, _mm256_blend_epi32(_mm256_setzero_si256(), carry, 0xf0));
+            _mm256_storeu_si256((__m256i*)out, _mm256_add_epi32(x, _mm256_set1_epi32(value)));
+            value = out[7];
+            out += 8;
+        }
+        it += 32;
+    }
+    decodeVarintBlocks16(it, end, out, value);
+    return out - first + decodeVarintsFrom(it, end, out, value);
+}
+
+// The unmasked AVX-512 intrinsics start from an undefined vector, gcc 12 reports it as uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f,avx512bw")))
+size_t decodeVarintsAvx512(const uint8_t* it, const uint8_t* end, int* out) {
+    int* first = out;
+    int value = 0;
+    const __m512i zero = _mm512_setzero_si512();
+    while (end - it >= 64) {
+        if (_mm512_movepi8_mask(_mm512_loadu_si512(it)) != 0) {
+            for (const uint8_t* blockEnd = it + 64; it < blockEnd; ) {
+                value += decodeVarint(it);
+                *out++ = value;
+            }
+            continue;
+        }
+        for (int i = 0; i < 64; i += 16) {
+            __m512i x = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(it + i)));
+            // alignr with zero shifts the lanes up by 1, 2, 4 and 8
+            x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, zero, 15));
+            x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, zero, 14));
+            x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, zero, 12));
+            x = _mm512_add_epi32(x, _mm512_alignr_epi32(x, zero, 8));
+            _mm512_storeu_si512(out, _mm512_add_epi32(x, _mm512_set1_epi32(value)));
+            value = out[15];
+            out += 16;
+        }
+        it += 64;
+    }
+    decodeVarintBlocks16(it, end, out, value);
+    return out - first + decodeVarintsFrom(it, end, out, value);
+}
+#pragma GCC diagnostic pop
+#endif
+
+// Word-wise dst |= src over n words of a bitset
+void orWordsScalar(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] |= src[i];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2")))
+void orWordsSse42(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_or_si128(_mm_loadu_si128((const __m128i*)(dst + i)), _mm_loadu_si128((const __m128i*)(src + i)));
+        _mm_storeu_si128((__m128i*)(dst + i), x);
+    }
+    orWordsScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void orWordsAvx2(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(dst + i)), _mm256_loadu_si256((const __m256i*)(src + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), x);
+    }
+    orWordsScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void orWordsAvx512(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_si512(dst + i, _mm512_or_si512(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+    }
+    orWordsScalar(dst + i, src + i, n - i);
+}
+#endif
+
+// Vectorised kernels, compiled for several instruction sets and picked once at start-up from the CPU,
+// PAL_SIMD (scalar, sse4.2, avx2, avx512) forces a level, a level the CPU lacks falls back to the best one it has
+struct SimdKernels {
+    enum Level { SCALAR, SSE42, AVX2, AVX512 };
+
+    Level level = SCALAR;
+    uint64_t (*digitMask)(const char* block) = nullptr;    // none on the scalar level, integers are parsed byte by byte
+    size_t (*decodeVarints)(const uint8_t* it, const uint8_t* end, int* out) = decodeVarintsScalar;
+    void (*orWords)(unsigned long long* dst, const unsigned long long* src, size_t n) = orWordsScalar;
+
+    static const char* levelName(Level level) {
+        const char* names[] = {"scalar", "sse4.2", "avx2", "avx512"};
+        return names[level];
+    }
+
+    SimdKernels() {
+        Level best = SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2")) {
+            best = SSE42;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            best = AVX2;
+        }
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+            best = AVX512;
+        }
+#endif
+        level = best;
+        const char* simdEnv = std::getenv("PAL_SIMD");
+        if (simdEnv != nullptr) {
+            for (int i = SCALAR; i <= AVX512; i++) {
+                if (std::string(simdEnv) == levelName((Level)i)) {
+                    level = std::min(best, (Level)i);
+                }
+            }
+        }
+
+#if defined(__x86_64__) || defined(__i386__)
+        if (level == SSE42) {
+            digitMask = digitMaskSse42;
+            decodeVarints = decodeVarintsSse42;
+            orWords = orWordsSse42;
+        } else if (level == AVX2) {
+            digitMask = digitMaskAvx2;
+            decodeVarints = decodeVarintsAvx2;
+            orWords = orWordsAvx2;
+        } else if (level == AVX512) {
+            digitMask = digitMaskAvx512;
+            decodeVarints = decodeVarintsAvx512;
+            orWords = orWordsAvx512;
+        }
+#endif
+    }
+
+    static const SimdKernels& get() {
+        static SimdKernels kernels;
+        return kernels;
+    }
+};
+
+// Hardware counter for the phase report, reads -1 when perf events are not available
+class PerfCounter {
+private:
+    int fd = -1;
+
+public:
+    PerfCounter() = default;
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    void open(unsigned int type, unsigned long long config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // Count threads spawned later as well, their counts are added when they exit (all are joined within a phase)
+        attr.inherit = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~PerfCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    long long read() const {
+        long long value = -1;
+        if (fd < 0 || ::read(fd, &value, sizeof(value)) != sizeof(value)) {
+            return -1;
+        }
+        return value;
+    }
+
+    static unsigned long long cacheMisses(unsigned long long cache) {
+        return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    }
+};
+
+class PhaseReport {
+private:
+    struct Phase {
+        std::string name;
+        double ms;
+        long long tlbMisses;
+        long long remoteMisses;
+    };
+
+    bool enabled;
+    std::vector<Phase> phases;
+    std::vector<std::string> notes;
+    std::string phaseName;
+    std::chrono::steady_clock::time_point phaseStart;
+    PerfCounter tlbCounter;
+    PerfCounter remoteCounter;
+    long long tlbStart = 0;
+    long long remoteStart = 0;
+
+    static long long delta(long long end, long long start) {
+        return end < 0 || start < 0 ? -1 : end - start;
+    }
+
+    static std::string counterText(long long value) {
+        return value < 0 ? "n/a" : std::to_string(value);
+    }
+
+public:
+    PhaseReport(bool enabled) : enabled(enabled) {
+        if (enabled) {
+            // dTLB load misses and loads served by a remote NUMA node
+            tlbCounter.open(PERF_TYPE_HW_CACHE, PerfCounter::cacheMisses(PERF_COUNT_HW_CACHE_DTLB));
+            remoteCounter.open(PERF_TYPE_HW_CACHE, PerfCounter::cacheMisses(PERF_COUNT_HW_CACHE_NODE));
+        }
+    }
+
+    bool isEnabled() const {
+        return enabled;
+    }
+
+    void start(const std::string& name) {
+        phaseName = name;
+        tlbStart = tlbCounter.read();
+        remoteStart = remoteCounter.read();
+        phaseStart = std::chrono::steady_clock::now();
+    }
+
+    double stop() {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - phaseStart).count();
+        phases.push_back({phaseName, ms, delta(tlbCounter.read(), tlbStart), delta(remoteCounter.read(), remoteStart)});
+        return ms;
+    }
+
+    double total(const std::string& name) const {
+        double ms = 0;
+        for (size_t i = 0; i < phases.size(); i++) {
+            if (phases[i].name == name) {
+                ms += phases[i].ms;
+            }
+        }
+        return ms;
+    }
+
+    void note(const std::string& line) {
+        notes.push_back(line);
+    }
+
+    void print() const {
+        if (!enabled) {
+            return;
+        }
+        // Report goes to stderr so the answer on stdout stays clean
+        for (size_t i = 0; i < phases.size(); i++) {
+            std::cerr << "phase " << phases[i].name << ": " << phases[i].ms << " ms, dTLB misses "
+                << counterText(phases[i].tlbMisses) << ", remote node misses " << counterText(phases[i].remoteMisses) << std::endl;
+        }
+
+        // How much of the process memory really ended up on huge pages
+        const LargeArrayConfig& config = LargeArrayConfig::get();
+        std::ifstream smaps("/proc/self/smaps_rollup");
+        std::string line;
+        std::string anonHugePages = "n/a";
+        while (std::getline(smaps, line)) {
+            if (line.compare(0, 14, "AnonHugePages:") == 0) {
+                anonHugePages = line.substr(14);
+                anonHugePages.erase(0, anonHugePages.find_first_not_of(' '));
+            }
+        }
+        std::cerr << "huge pages: " << (config.hugePageBytes >> 20) << " MiB advised, " << (config.hugetlbBytes >> 20)
+            << " MiB hugetlbfs, AnonHugePages " << anonHugePages << std::endl;
+        std::cerr << "simd: " << SimdKernels::levelName(SimdKernels::get().level) << std::endl;
+        std::cerr << "numa: " << config.numNodes() << " nodes, placement "
+            << (config.interleave ? "interleave" : config.firstTouch ? "firsttouch" : "default") << std::endl;
+
+        for (size_t i = 0; i < notes.size(); i++) {
+            std::cerr << notes[i] << std::endl;
+        }
+    }
+};
+
+typedef std::vector<std::tuple<int, int>, LargeArrayAllocator<std::tuple<int, int>>> EdgeList;
+
+// Adjacency list in two flat arrays, neighbours of node i are neighbour[start[i]] .. neighbour[start[i + 1] - 1]
+struct FlatAdjacencyList {
+    std::vector<int, LargeArrayAllocator<int>> start;
+    std::vector<int, LargeArrayAllocator<int>> neighbour;
+
+    int degree(int node) const {
+        return start[node + 1] - start[node];
+    }
+
+    const int* begin(int node) const {
+        return neighbour.data() + start[node];
+    }
+
+    const int* end(int node) const {
+        return neighbour.data() + start[node + 1];
+    }
+
+    size_t memoryBytes() const {
+        return (start.size() + neighbour.size()) * sizeof(int);
+    }
+
+    // Walks the neighbours of one node, same interface as the compressed list
+    struct Cursor {
+        const int* it;
+        const int* last;
+
+        bool next(int& neighbour) {
+            if (it == last) {
+                return false;
+            }
+            neighbour = *it++;
+            return true;
+        }
+    };
+
+    Cursor neighbours(int node) const {
+        return {begin(node), end(node)};
+    }
+
+    // Neighbours of one node as a plain array, same interface as the compressed list (which needs the buffer)
+    const int* neighbourArray(int node, std::vector<int>& /* buffer */, int& count) const {
+        count = degree(node);
+        return begin(node);
+    }
+
+    // A list is built in two passes: prepare(N), sizeList(...) for every node, allocate(), then storeList(...)
+    // for every node with the same neighbours, same interface as the compressed list
+    void prepare(int N) {
+        start.assign(N + 2, 0);
+    }
+
+    void sizeList(int node, const int* first, const int* last) {
+        start[node + 1] = last - first;
+    }
+
+    void allocate() {
+        for (size_t i = 1; i < start.size(); i++) {
+            start[i] += start[i - 1];
+        }
+        neighbour.resize(start.back());
+    }
+
+    void storeList(int node, const int* first, const int* last) {
+        std::copy(first, last, neighbour.begin() + start[node]);
+    }
+};
+
+// Adjacency list with sorted neighbours stored as varint deltas, neighbours of node i are encoded in bytes[begin(i)] .. bytes[begin(i + 1) - 1]
+struct CompressedAdjacencyList {
+    // Nodes go in blocks of 2^blockShift, a block has a 64 bit offset and its nodes 32 bit ones relative to it,
+    // so offsets take about 4 bytes per node without limiting the number of edges. Blocks have up to 64 nodes,
+    // fewer when the lists of a block would not fit 32 bits (one node per block always fits)
+    std::vector<uint64_t, LargeArrayAllocator<uint64_t>> blockStart;
+    std::vector<uint32_t, LargeArrayAllocator<uint32_t>> offset;
+    int blockShift = 0;
+    std::vector<uint8_t, LargeArrayAllocator<uint8_t>> bytes;
+
+    size_t memoryBytes() const {
+        return blockStart.size() * sizeof(uint64_t) + offset.size() * sizeof(uint32_t) + bytes.size();
+    }
+
+    uint64_t begin(int node) const {
+        return blockStart[node >> blockShift] + offset[node];
+    }
+
+    // Decodes the neighbours of one node in increasing order
+    struct Cursor {
+        const uint8_t* it;
+        const uint8_t* last;
+        int value;
+
+        bool next(int& neighbour) {
+            if (it == last) {
+                return false;
+            }
+            value += decodeVarint(it);
+            neighbour = value;
+            return true;
+        }
+    };
+
+    Cursor neighbours(int node) const {
+        return {bytes.data() + begin(node), bytes.data() + begin(node + 1), 0};
+    }
+
+    // Decodes all neighbours of one node into buffer at once, with the vector kernel picked at start-up
+    const int* neighbourArray(int node, std::vector<int>& buffer, int& count) const {
+        // Every neighbour takes at least one byte
+        const uint8_t* first = bytes.data() + begin(node);
+        const uint8_t* last = bytes.data() + begin(node + 1);
+        if (buffer.size() < (size_t)(last - first)) {
+            buffer.resize(last - first);
+        }
+        count = SimdKernels::get().decodeVarints(first, last, buffer.data());
+        return buffer.data();
+    }
+
+    // Two-pass building as in the flat list, the neighbours have to be sorted, the first one is stored
+    // as delta from 0. Sizes wait in offset[node + 1], one list fits 32 bits: it has less than 2^31 neighbours
+    // and as its deltas sum up to less than 2^31, at most 2^24 of them take more than one byte
+    void prepare(int N) {
+        offset.assign(N + 2, 0);
+    }
+
+    void sizeList(int node, const int* first, const int* last) {
+        uint32_t size = 0;
+        int previous = 0;
+        for (const int* it = first; it != last; ++it) {
+            size += varintSize(*it - previous);
+            previous = *it;
+        }
+        offset[node + 1] = size;
+    }
+
+    void allocate() {
+        // The largest block of up to 64 nodes whose lists (but the last one) fit 32 bits
+        size_t n = offset.size();
+        for (blockShift = 6; blockShift > 0; blockShift--) {
+            uint64_t span = 0;
+            size_t i = 1;
+            for (; i < n; i++) {
+                span = (i & ((1u << blockShift) - 1)) == 0 ? 0 : span + offset[i];
+                if (span > 0xffffffffu) {
+                    break;
+                }
+            }
+            if (i == n) {
+                break;
+            }
+        }
+
+        // Sizes to offsets in place
+        blockStart.resize(((n - 1) >> blockShift) + 1);
+        uint64_t position = 0;
+        for (size_t i = 0; i < n; i++) {
+            position += offset[i];
+            if ((i & ((1u << blockShift) - 1)) == 0) {
+                blockStart[i >> blockShift] = position;
+            }
+            offset[i] = (uint32_t)(position - blockStart[i >> blockShift]);
+        }
+        bytes.resize(position);
+    }
+
+    void storeList(int node, const int* first, const int* last) {
+        uint8_t* out = bytes.data() + begin(node);
+        int previous = 0;
+        for (const int* it = first; it != last; ++it) {
+            unsigned delta = *it - previous;
+            previous = *it;
+            while (delta >= 0x80) {
+                *out++ = (uint8_t)(delta | 0x80);
+                delta >>= 7;
+            }
+            *out++ = (uint8_t)delta;
+        }
+    }
+};
 
 void loadStarts(std::vector<int>& starts, int A) {
     for(size_t i = 0; i < A; i++) {
@@ -11,15 +764,435 @@ void loadStarts(std::vector<int>& starts, int A) {
     }
 }
 
-void loadInputEdges(std::vector<std::tuple<int, int>>& edges, int M) {
-    for (size_t i = 0; i < M; i++) {
+void runTasksInParallel(int numTasks, const std::function<void(int)>& task) {
+    int numThreads = std::min<int>(std::max(1u, std::thread::hardware_concurrency()), numTasks);
+    std::atomic<int> nextTask(0);
+
+    auto worker = [&]() {
+        // Take tasks one by one until all of them are done
+        for (int i = nextTask++; i < numTasks; i = nextTask++) {
+            task(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numThreads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+}
+
+std::vector<char> readRemainingInput() {
+    std::vector<char> buffer;
+    size_t length = 0;
+
+    // Reserve the whole rest of the file at once when stdin is a regular file
+    struct stat info;
+    long position = std::ftell(stdin);
+    if (fstat(fileno(stdin), &info) == 0 && S_ISREG(info.st_mode) && position >= 0 && info.st_size > position) {
+        buffer.resize(info.st_size - position + 1);
+    }
+
+    while (true) {
+        if (length == buffer.size()) {
+            buffer.resize(std::max<size_t>(1 << 16, 2 * buffer.size()));
+        }
+        size_t bytesRead = std::fread(buffer.data() + length, 1, buffer.size() - length, stdin);
+        if (bytesRead == 0) {
+            break;
+        }
+        length += bytesRead;
+    }
+
+    buffer.resize(length);
+    return buffer;
+}
+
+const char* parseInteger(const char* it, const char* end, int& value, bool& found) {
+    // Skip everything up to the next number, a minus sign counts only right before a digit
+    while (it != end && !(*it >= '0' && *it <= '9') && !(*it == '-' && it + 1 != end && it[1] >= '0' && it[1] <= '9')) {
+        ++it;
+    }
+    found = it != end;
+    if (!found) {
+        return it;
+    }
+
+    bool negative = *it == '-';
+    if (negative) {
+        ++it;
+    }
+    value = 0;
+    while (it != end && *it >= '0' && *it <= '9') {
+        value = value * 10 + (*it - '0');
+        ++it;
+    }
+    if (negative) {
+        value = -value;
+    }
+    return it;
+}
+
+// Value of the first length (at most 8) digits at it, all 8 bytes are read at once
+inline int parseEightDigits(const char* it, int length) {
+    uint64_t chunk;
+    std::memcpy(&chunk, it, 8);
+    // Bytes after the digits may borrow while subtracting '0', but only upwards and they are shifted out,
+    // the shift moves the first digit to the top as if the number had leading zeros
+    chunk = (chunk - 0x3030303030303030ULL) << (8 * (8 - length));
+    chunk = chunk * 10 + (chunk >> 8);
+    chunk = ((chunk & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))
+        + ((chunk >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32))) >> 32;
+    return (int)chunk;
+}
+
+// Parses all integers of [begin, end) into numbers, finding them through the digit mask of 64-byte blocks
+void parseIntegerRange(const char* begin, const char* end, std::vector<int>& numbers) {
+    uint64_t (*digitMask)(const char* block) = SimdKernels::get().digitMask;
+    const char* it = begin;
+    int value;
+    bool found;
+    while (digitMask != nullptr && end - it >= 64) {
+        uint64_t digits = digitMask(it);
+        if (digits == ~0ULL) {
+            // Number longer than a block, its minus sign is just before the block
+            it = parseInteger(it > begin && it[-1] == '-' ? it - 1 : it, end, value, found);
+            numbers.push_back(value);
+            continue;
+        }
+
+        // A number touching the block end may go on, it is parsed with the next block
+        const char* next = it + 64;
+        if (digits >> 63) {
+            int lastStart = 64 - __builtin_clzll(~digits);
+            digits &= (1ULL << lastStart) - 1;
+            next = it + lastStart;
+        }
+
+        uint64_t starts = digits & ~(digits << 1);
+        while (starts != 0) {
+            int first = __builtin_ctzll(starts);
+            int last = first + __builtin_ctzll(~(digits >> first));
+            if (last - first <= 8 && end - (it + first) >= 8) {
+                value = parseEightDigits(it + first, last - first);
+            } else {
+                value = 0;
+                for (int i = first; i < last; i++) {
+                    value = value * 10 + (it[i] - '0');
+                }
+            }
+            // A minus sign counts only right before a digit
+            bool negative = first > 0 ? it[first - 1] == '-' : it > begin && it[-1] == '-';
+            numbers.push_back(negative ? -value : value);
+            starts &= starts - 1;
+        }
+        it = next;
+    }
+
+    // Tail shorter than a block, or everything on the scalar level
+    if (it > begin && it[-1] == '-') {
+        --it;
+    }
+    while (true) {
+        it = parseInteger(it, end, value, found);
+        if (!found) {
+            break;
+        }
+        numbers.push_back(value);
+    }
+}
+
+// Parses the first count integers of the buffer with all cores and hands them to store(index, value),
+// returns the offset right after the last parsed integer
+template <typename Store>
+size_t parseIntegersInParallel(const std::vector<char>& buffer, size_t count, Store store) {
+    if (count == 0) {
+        return 0;
+    }
+    const char* data = buffer.data();
+    const char* dataEnd = data + buffer.size();
+
+    // Split the buffer into chunks that end on a whitespace, so no number is cut in half
+    int numChunks = std::max(1u, std::thread::hardware_concurrency()) * 4;
+    std::vector<const char*> chunkStart(numChunks + 1, dataEnd);
+    chunkStart[0] = data;
+    for (int c = 1; c < numChunks; c++) {
+        const char* it = std::max(chunkStart[c - 1], data + buffer.size() / numChunks * c);
+        while (it != dataEnd && !std::isspace((unsigned char)*it)) {
+            ++it;
+        }
+        chunkStart[c] = it;
+    }
+
+    // Every chunk is parsed into its own buffer
+    std::vector<std::vector<int>> chunkNumbers(numChunks);
+    runTasksInParallel(numChunks, [&](int c) {
+        std::vector<int>& numbers = chunkNumbers[c];
+        numbers.reserve((chunkStart[c + 1] - chunkStart[c]) / 4);
+        parseIntegerRange(chunkStart[c], chunkStart[c + 1], numbers);
+    });
+
+    // Merge chunk buffers into their place in the output
+    std::vector<size_t> firstIndex(numChunks + 1, 0);
+    for (int c = 0; c < numChunks; c++) {
+        firstIndex[c + 1] = firstIndex[c] + chunkNumbers[c].size();
+    }
+    runTasksInParallel(numChunks, [&](int c) {
+        for (size_t i = 0; i < chunkNumbers[c].size() && firstIndex[c] + i < count; i++) {
+            store(firstIndex[c] + i, chunkNumbers[c][i]);
+        }
+    });
+
+    // Find where the last wanted number ends, the rest of the input stays for the caller
+    if (firstIndex[numChunks] <= count) {
+        return buffer.size();
+    }
+    int lastChunk = std::upper_bound(firstIndex.begin(), firstIndex.end(), count - 1) - firstIndex.begin() - 1;
+    const char* it = chunkStart[lastChunk];
+    int value;
+    bool found;
+    for (size_t i = firstIndex[lastChunk]; i < count; i++) {
+        it = parseInteger(it, chunkStart[lastChunk + 1], value, found);
+    }
+    return it - data;
+}
+
+void loadInputEdges(EdgeList& edges, int M) {
+    std::vector<char> buffer = readRemainingInput();
+
+    // Every edge is two integers n1, n2
+    edges.resize(M);
+    parseIntegersInParallel(buffer, 2 * (size_t)M, [&](size_t index, int value) {
+        if (index % 2 == 0) {
+            std::get<0>(edges[index / 2]) = value;
+        } else {
+            std::get<1>(edges[index / 2]) = value;
+        }
+    });
+}
+
+// Bounded lock-free queue for exactly one producer and one consumer thread
+template <typename T>
+class SpscQueue {
+private:
+    std::vector<T> slots;
+    std::atomic<size_t> head;   // next slot to pop
+    std::atomic<size_t> tail;   // next slot to push
+
+public:
+    SpscQueue(size_t capacity) : slots(capacity + 1), head(0), tail(0) {}
+
+    bool tryPush(const T& value) {
+        size_t current = tail.load(std::memory_order_relaxed);
+        size_t next = (current + 1) % slots.size();
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[current] = value;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        size_t current = head.load(std::memory_order_relaxed);
+        if (current == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[current];
+        head.store((current + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    void push(const T& value) {
+        while (!tryPush(value)) {
+            std::this_thread::yield();
+        }
+    }
+
+    T pop() {
+        T value;
+        while (!tryPop(value)) {
+            std::this_thread::yield();
+        }
+        return value;
+    }
+};
+
+// Parses integers from stdin on its own thread and hands them over in fixed-size batches,
+// at most numBatches batches exist at once, so memory stays bounded whatever the input size
+class IntegerStream {
+private:
+    static const size_t batchSize = 1 << 16;
+    static const size_t blockSize = 1 << 20;
+    static const int numBatches = 8;
+
+    std::vector<std::vector<int>> batches;
+    SpscQueue<int> filledBatches;
+    SpscQueue<int> freeBatches;
+    int currentBatch = -1;
+    std::string rest;
+    std::thread reader;
+
+    void readInput(size_t count) {
+        std::vector<char> block(blockSize);
+        int batch = freeBatches.pop();
+        size_t parsed = 0;
+        int value = 0;
+        bool inNumber = false;
+        bool negative = false;
+        bool afterMinus = false;
+        size_t bytesRead = 0;
+        size_t restStart = 0;
+        bool stoppedInBlock = false;
+
+        auto emit = [&]() {
+            batches[batch].push_back(negative ? -value : value);
+            parsed++;
+            inNumber = false;
+            if (batches[batch].size() == batchSize) {
+                filledBatches.push(batch);
+                batch = freeBatches.pop();
+                batches[batch].clear();
+            }
+        };
+
+        // The state of a number is kept between blocks, so numbers split by a block border are fine
+        while (parsed < count) {
+            bytesRead = std::fread(block.data(), 1, blockSize, stdin);
+            if (bytesRead == 0) {
+                break;
+            }
+            for (restStart = 0; restStart < bytesRead; restStart++) {
+                char c = block[restStart];
+                if (c >= '0' && c <= '9') {
+                    if (!inNumber) {
+                        inNumber = true;
+                        negative = afterMinus;
+                        value = 0;
+                    }
+                    value = value * 10 + (c - '0');
+                } else if (inNumber) {
+                    emit();
+                    if (parsed == count) {
+                        stoppedInBlock = true;
+                        break;
+                    }
+                }
+                afterMinus = c == '-';
+            }
+        }
+        if (inNumber && parsed < count) {
+            // Last number ends with the input
+            emit();
+        }
+
+        // Flush the last partial batch and mark the end with an empty one
+        if (!batches[batch].empty()) {
+            filledBatches.push(batch);
+            batch = freeBatches.pop();
+        }
+        batches[batch].clear();
+        filledBatches.push(batch);
+
+        // Whatever follows the wanted integers stays for the caller, all of the input when none were wanted
+        // and nothing when the last one ended the input
+        if (stoppedInBlock) {
+            rest.assign(block.begin() + restStart, block.begin() + bytesRead);
+        }
+        if (parsed == count) {
+            while ((bytesRead = std::fread(block.data(), 1, blockSize, stdin)) > 0) {
+                rest.append(block.begin(), block.begin() + bytesRead);
+            }
+        }
+    }
+
+public:
+    IntegerStream(size_t count) : batches(numBatches), filledBatches(numBatches), freeBatches(numBatches) {
+        for (int i = 0; i < numBatches; i++) {
+            batches[i].reserve(batchSize);
+            freeBatches.push(i);
+        }
+        reader = std::thread(&IntegerStream::readInput, this, count);
+    }
+
+    ~IntegerStream() {
+        if (reader.joinable()) {
+            reader.join();
+        }
+    }
+
+    // Returns the next batch, the previous one is given back to the reader, empty batch means the end
+    const std::vector<int>& nextBatch() {
+        if (currentBatch >= 0) {
+            freeBatches.push(currentBatch);
+        }
+        currentBatch = filledBatches.pop();
+        return batches[currentBatch];
+    }
+
+    // Input that follows the wanted integers, call after the empty batch was returned
+    std::string takeRest() {
+        reader.join();
+        return rest;
+    }
+};
+
+void fillAdjacencyList(FlatAdjacencyList& adjacencyList, FlatAdjacencyList& adjacencyListReverse, const EdgeList& edges, const int N) {
+    // Expects out-degree and in-degree of node i in start[i + 1]
+    for(int i = 1; i < N + 2; i++) {
+        adjacencyList.start[i] += adjacencyList.start[i - 1];
+        adjacencyListReverse.start[i] += adjacencyListReverse.start[i - 1];
+    }
+
+    std::vector<int> position(adjacencyList.start.begin(), adjacencyList.start.end() - 1);
+    std::vector<int> positionReverse(adjacencyListReverse.start.begin(), adjacencyListReverse.start.end() - 1);
+    adjacencyList.neighbour.resize(edges.size());
+    adjacencyListReverse.neighbour.resize(edges.size());
+    for(size_t i = 0; i < edges.size(); i++) {
         int n1, n2;
-        std::cin >> n1 >> n2;
-        edges.emplace_back(n1, n2);
+        std::tie(n1, n2) = edges[i];
+        // Save nodes in the correct direction
+        adjacencyList.neighbour[position[n1]++] = n2;
+        // Save nodes in the reverse direction to create reversed graph
+        adjacencyListReverse.neighbour[positionReverse[n2]++] = n1;
+    }
+}
+
+void streamAdjacencyList(FlatAdjacencyList& adjacencyList, FlatAdjacencyList& adjacencyListReverse, const int N, const int M) {
+    // Edges go to a flat list and degrees are counted while the reader thread is still parsing,
+    // then edges are scattered to their nodes and the list is freed
+    IntegerStream stream(2 * (size_t)M);
+    EdgeList edges;
+    edges.reserve(M);
+    adjacencyList.start.assign(N + 2, 0);
+    adjacencyListReverse.start.assign(N + 2, 0);
+    int edge[2];
+    size_t index = 0;
+
+    while (true) {
+        const std::vector<int>& batch = stream.nextBatch();
+        if (batch.empty()) {
+            break;
+        }
+        for (size_t i = 0; i < batch.size(); i++, index++) {
+            edge[index % 2] = batch[i];
+            if (index % 2 == 1) {
+                edges.emplace_back(edge[0], edge[1]);
+                adjacencyList.start[edge[0] + 1]++;
+                adjacencyListReverse.start[edge[1] + 1]++;
+            }
+        }
     }
+    stream.takeRest();
+
+    fillAdjacencyList(adjacencyList, adjacencyListReverse, edges, N);
 }
 
-void printEdges(const std::vector<std::tuple<int, int>>& edges) {
+void printEdges(const EdgeList& edges) {
     for (size_t i = 0; i < edges.size(); i++) {
         int n1, n2;
         std::tie(n1, n2) = edges[i];
@@ -27,34 +1200,155 @@ void printEdges(const std::vector<std::tuple<int, int>>& edges) {
     }
 }
 
-void createAdjacencyList(std::vector<std::vector<int>>& adjacencyList, std::vector<std::vector<int>>& adjacencyListReverse, const std::vector<std::tuple<int, int>>& edges, const int M) {
-    for(size_t i = 0; i < M; i++) {
-        int n1, n2;
-        std::tie(n1, n2) = edges[i];
-        // Save nodes in the correct direction
-        adjacencyList[n1].push_back(n2);
-        // Save nodes in the reverse direction to create reversed graph
-        adjacencyListReverse[n2].push_back(n1);
+void createAdjacencyList(FlatAdjacencyList& adjacencyList, FlatAdjacencyList& adjacencyListReverse, const EdgeList& edges, const int N) {
+    // Count out-degrees and in-degrees
+    adjacencyList.start.assign(N + 2, 0);
+    adjacencyListReverse.start.assign(N + 2, 0);
+    for(size_t i = 0; i < edges.size(); i++) {
+        adjacencyList.start[std::get<0>(edges[i]) + 1]++;
+        adjacencyListReverse.start[std::get<1>(edges[i]) + 1]++;
     }
+
+    fillAdjacencyList(adjacencyList, adjacencyListReverse, edges, N);
 }
 
-void printAdjacencyList(const std::vector<std::vector<int>>& adjacencyList) {
-    for (size_t i = 1; i < adjacencyList.size(); i++) {
+void printAdjacencyList(const FlatAdjacencyList& adjacencyList) {
+    for (size_t i = 1; i + 1 < adjacencyList.start.size(); i++) {
         std::cout << i << ": ";
-        for (size_t j = 0; j < adjacencyList[i].size(); j++) {
-            std::cout << adjacencyList[i][j] << " ";
+        for (const int* it = adjacencyList.begin(i); it != adjacencyList.end(i); ++it) {
+            std::cout << *it << " ";
         }
         std::cout << "\n";
     }
 }
 
-void firstDFS(const int n, const std::vector<std::vector<int>>& adjacencyList, std::vector<bool>& visited, std::stack<int>& stack) {
+// Moves the flat list into the target representation, the flat arrays are freed
+void convertAdjacencyList(FlatAdjacencyList& flat, FlatAdjacencyList& target) {
+    std::swap(flat, target);
+}
+
+void convertAdjacencyList(FlatAdjacencyList& flat, CompressedAdjacencyList& target) {
+    int N = (int)flat.start.size() - 2;
+
+    // Sorted neighbours give small non-negative deltas, the first one is stored as delta from 0
+    runTasksInParallel(N, [&](int i) {
+        std::sort(flat.neighbour.begin() + flat.start[i + 1], flat.neighbour.begin() + flat.start[i + 2]);
+    });
+
+    // Count bytes of every node first, then encode into one array
+    target.prepare(N);
+    for (int i = 0; i <= N; i++) {
+        target.sizeList(i, flat.begin(i), flat.end(i));
+    }
+    target.allocate();
+    for (int i = 0; i <= N; i++) {
+        target.storeList(i, flat.begin(i), flat.end(i));
+    }
+
+    FlatAdjacencyList().start.swap(flat.start);
+    FlatAdjacencyList().neighbour.swap(flat.neighbour);
+}
+
+void compressEdges(const EdgeList& edges, const int N, bool reverse, CompressedAdjacencyList& target) {
+    // Builds the flat list of one direction only from its degree count, so at most one flat list
+    // lives next to the edges while the compressed lists are built
+    FlatAdjacencyList flat;
+    flat.start.assign(N + 2, 0);
+    for (size_t i = 0; i < edges.size(); i++) {
+        flat.start[(reverse ? std::get<1>(edges[i]) : std::get<0>(edges[i])) + 1]++;
+    }
+    for (int i = 1; i < N + 2; i++) {
+        flat.start[i] += flat.start[i - 1];
+    }
+
+    std::vector<int> position(flat.start.begin(), flat.start.end() - 1);
+    flat.neighbour.resize(edges.size());
+    for (size_t i = 0; i < edges.size(); i++) {
+        int n1, n2;
+        std::tie(n1, n2) = edges[i];
+        if (reverse) {
+            flat.neighbour[position[n2]++] = n1;
+        } else {
+            flat.neighbour[position[n1]++] = n2;
+        }
+    }
+    convertAdjacencyList(flat, target);
+}
+
+std::vector<int> computeNodeOrder(const FlatAdjacencyList& adjacencyList, const FlatAdjacencyList& adjacencyListReverse, const int N, const std::string& method) {
+    // Returns new id of every node
+    std::vector<int> order;
+    order.reserve(N);
+
+    auto degree = [&](int node) {
+        return adjacencyList.degree(node) + adjacencyListReverse.degree(node);
+    };
+
+    if (method == "bfs" || method == "rcm") {
+        // Visit nodes in BFS order ignoring edge directions, RCM takes neighbours by increasing degree
+        std::vector<bool> visited(N + 1, false);
+        std::vector<int> neighbours;
+        size_t head = 0;
+        for (int seed = 1; seed <= N; seed++) {
+            if (!visited[seed]) {
+                visited[seed] = true;
+                order.push_back(seed);
+            }
+            while (head < order.size()) {
+                int node = order[head++];
+                neighbours.assign(adjacencyList.begin(node), adjacencyList.end(node));
+                neighbours.insert(neighbours.end(), adjacencyListReverse.begin(node), adjacencyListReverse.end(node));
+                if (method == "rcm") {
+                    std::stable_sort(neighbours.begin(), neighbours.end(), [&](int a, int b) {
+                        return degree(a) < degree(b);
+                    });
+                }
+                for (size_t j = 0; j < neighbours.size(); j++) {
+                    if (!visited[neighbours[j]]) {
+                        visited[neighbours[j]] = true;
+                        order.push_back(neighbours[j]);
+                    }
+                }
+            }
+        }
+        if (method == "rcm") {
+            std::reverse(order.begin(), order.end());
+        }
+    } else if (method == "degree") {
+        // Hubs first, so the most often touched nodes share cache lines
+        for (int i = 1; i <= N; i++) {
+            order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return degree(a) > degree(b);
+        });
+    } else {
+        std::cerr << "Unknown node order: " << method << std::endl;
+        return std::vector<int>();
+    }
+
+    std::vector<int> newId(N + 1, 0);
+    for (int i = 0; i < N; i++) {
+        newId[order[i]] = i + 1;
+    }
+    return newId;
+}
+
+void relabelEdges(EdgeList& edges, const std::vector<int>& newId) {
+    for (size_t i = 0; i < edges.size(); i++) {
+        std::get<0>(edges[i]) = newId[std::get<0>(edges[i])];
+        std::get<1>(edges[i]) = newId[std::get<1>(edges[i])];
+    }
+}
+
+template<class Graph>
+void firstDFS(const int n, const Graph& adjacencyList, std::vector<bool>& visited, std::stack<int>& stack) {
     visited[n] = true;
 
     // Get neighbours of current node
-    std::vector<int> neighbours = adjacencyList[n];
-    for(size_t i = 0; i < neighbours.size(); i++) {
-        int neighbour = neighbours[i];
+    typename Graph::Cursor neighbours = adjacencyList.neighbours(n);
+    int neighbour;
+    while(neighbours.next(neighbour)) {
         if(visited[neighbour] == false) {
             // Neighbour is unvisited
             firstDFS(neighbour, adjacencyList, visited, stack);
@@ -65,14 +1359,15 @@ void firstDFS(const int n, const std::vector<std::vector<int>>& adjacencyList, s
     stack.emplace(n);
 }
 
-void secondDFS(const int n, const std::vector<std::vector<int>>& adjacencyListReverse, std::vector<bool>& visited, std::vector<int>& SCC, int numSCC) {
+template<class Graph>
+void secondDFS(const int n, const Graph& adjacencyListReverse, std::vector<bool>& visited, std::vector<int>& SCC, int numSCC) {
     visited[n] = true;
     SCC[n] = numSCC;
 
     // Get neighbours of current node
-    std::vector<int> neighbours = adjacencyListReverse[n];
-    for(size_t i = 0; i < neighbours.size(); i++) {
-        int neighbour = neighbours[i];
+    typename Graph::Cursor neighbours = adjacencyListReverse.neighbours(n);
+    int neighbour;
+    while(neighbours.next(neighbour)) {
         if(visited[neighbour] == false) {
             // Neighbour is unvisited
             secondDFS(neighbour, adjacencyListReverse, visited, SCC, numSCC);
@@ -92,7 +1387,8 @@ void printStack(std::stack<int>& stack) {
     std::cout << std::endl;
 }
 
-void kosarajuSharirAlgorithm(const std::vector<std::vector<int>>& adjacencyList, const std::vector<std::vector<int>>& adjacencyListReverse, const int N, std::vector<int>& SCC, int& numSCC) {
+template<class Graph>
+void kosarajuSharirAlgorithm(const Graph& adjacencyList, const Graph& adjacencyListReverse, const int N, std::vector<int>& SCC, int& numSCC) {
     std::stack<int> stack;
     std::vector<bool> visited(N + 1, false);
     
@@ -117,51 +1413,101 @@ void kosarajuSharirAlgorithm(const std::vector<std::vector<int>>& adjacencyList,
     }
 }
 
-void createAdjacencyListSCC(const std::vector<std::vector<int>>& adjacencyList, const std::vector<int>& SCC, std::vector<std::vector<int>>& adjacencyListSCC, std::vector<std::vector<int>>& adjacencyListSCCReverse, const int N, const int numSCC) {
-    std::vector<std::set<int>> tempAdj(numSCC + 1);
-    std::vector<std::set<int>> tempRev(numSCC + 1);
-
-    for (int i = 1; i <= N; i++) {
-        for (int neighbour : adjacencyList[i]) {
-            int n1Comp = SCC[i];
-            int n2Comp = SCC[neighbour];
-            if (n1Comp != n2Comp) {
-                tempAdj[n1Comp].insert(n2Comp);
-                tempRev[n2Comp].insert(n1Comp);
+template<class Graph>
+void condenseAdjacencyList(const Graph& adjacencyList, const std::vector<int>& SCC, const std::vector<int>& nodesOf, const std::vector<int>& firstNode, const int numSCC, Graph& adjacencyListSCC) {
+    // Neighbour components of every component are collected once, seenFrom[d] == c marks d as already found from c.
+    // The first pass sizes the lists and the second one stores them, straight in the representation of the graph
+    std::vector<int> seenFrom(numSCC + 1, 0);
+    std::vector<int> list;
+    std::vector<int> buffer;
+    adjacencyListSCC.prepare(numSCC);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int c = 1; c <= numSCC; c++) {
+            list.clear();
+            for (int k = firstNode[c]; k < firstNode[c + 1]; k++) {
+                int degree;
+                const int* neighbours = adjacencyList.neighbourArray(nodesOf[k], buffer, degree);
+                for (int j = 0; j < degree; j++) {
+                    int neighbourComp = SCC[neighbours[j]];
+                    if (neighbourComp != c && seenFrom[neighbourComp] != c) {
+                        seenFrom[neighbourComp] = c;
+                        list.push_back(neighbourComp);
+                    }
+                }
             }
+            std::sort(list.begin(), list.end());
+            if (pass == 0) {
+                adjacencyListSCC.sizeList(c, list.data(), list.data() + list.size());
+            } else {
+                adjacencyListSCC.storeList(c, list.data(), list.data() + list.size());
+            }
+        }
+        if (pass == 0) {
+            adjacencyListSCC.allocate();
+            seenFrom.assign(numSCC + 1, 0);
         }
     }
+}
 
-    // Convert sets to vectors
-    for (int i = 1; i <= numSCC; i++) {
-        adjacencyListSCC[i].assign(tempAdj[i].begin(), tempAdj[i].end());
-        adjacencyListSCCReverse[i].assign(tempRev[i].begin(), tempRev[i].end());
+template<class Graph>
+void createAdjacencyListSCC(const Graph& adjacencyList, const Graph& adjacencyListReverse, const std::vector<int>& SCC, Graph& adjacencyListSCC, Graph& adjacencyListSCCReverse, const int N, const int numSCC) {
+    // Group nodes by component, then condense both directions without an intermediate list
+    std::vector<int> firstNode(numSCC + 2, 0);
+    for (int i = 1; i <= N; i++) {
+        firstNode[SCC[i] + 1]++;
     }
+    for (int i = 1; i < numSCC + 2; i++) {
+        firstNode[i] += firstNode[i - 1];
+    }
+    std::vector<int> nodesOf(N);
+    std::vector<int> position(firstNode.begin(), firstNode.end() - 1);
+    for (int i = 1; i <= N; i++) {
+        nodesOf[position[SCC[i]]++] = i;
+    }
+    std::vector<int>().swap(position);
+
+    condenseAdjacencyList(adjacencyList, SCC, nodesOf, firstNode, numSCC, adjacencyListSCC);
+    condenseAdjacencyList(adjacencyListReverse, SCC, nodesOf, firstNode, numSCC, adjacencyListSCCReverse);
 }
 
-void getReachableCompsFromStarts(const std::vector<int>& starts, const std::vector<int>& SCC, const std::vector<std::vector<int>>& adjacencyListSCC, std::vector<int>& reachableFromStarts, const int& numSCC, const int& A) {
-    // For start node run bfs to get what components are reachable from that start
-    for(size_t i = 0; i < A; i++) {
-        int startId = starts[i];
-        int startIdSCC = SCC[startId];
-        std::vector<bool> visited(numSCC + 1, false);
-        std::queue<int> queue;
-
-        queue.push(startIdSCC);
-        visited[startIdSCC] = true;
-        
-        while(!queue.empty()) {
-            int nodeSCC = queue.front();
-            queue.pop();
-                
-            reachableFromStarts[nodeSCC]++;
-            
-            std::vector<int> neighbours = adjacencyListSCC[nodeSCC];
-            for(size_t i = 0; i < neighbours.size(); i++) {
-                int neighbour = neighbours[i];
-                if(visited[neighbour] == false) {
-                    visited[neighbour] = true;
-                    queue.push(neighbour);
+template<class Graph>
+void getReachableCompsFromStarts(const std::vector<int>& starts, const std::vector<int>& SCC, const Graph& adjacencyListSCC, std::vector<int>& reachableFromStarts, const int& numSCC, const int& A) {
+    // Component ids follow the topological order of the condensed graph, so one pass in id order
+    // ORs the set of starts reaching a component into its successors instead of a bfs per start.
+    // Starts go in chunks of up to 512, sets of 4 or more words go through the vector kernel
+    const int maxWords = 8;
+    const int vectorWords = 4;
+    void (*orWords)(unsigned long long* dst, const unsigned long long* src, size_t n) = SimdKernels::get().orWords;
+    std::vector<int> buffer;
+    for (int first = 0; first < A; first += 64 * maxWords) {
+        int count = std::min(A - first, 64 * maxWords);
+        int words = (count + 63) / 64;
+        std::vector<unsigned long long> reached((size_t)(numSCC + 1) * words, 0);
+        for (int i = 0; i < count; i++) {
+            reached[(size_t)SCC[starts[first + i]] * words + i / 64] |= 1ull << (i % 64);
+        }
+
+        for (int nodeSCC = 1; nodeSCC <= numSCC; nodeSCC++) {
+            const unsigned long long* set = reached.data() + (size_t)nodeSCC * words;
+            int reachedBy = 0;
+            for (int w = 0; w < words; w++) {
+                reachedBy += __builtin_popcountll(set[w]);
+            }
+            if (reachedBy == 0) {
+                continue;
+            }
+            reachableFromStarts[nodeSCC] += reachedBy;
+
+            int degree;
+            const int* neighbours = adjacencyListSCC.neighbourArray(nodeSCC, buffer, degree);
+            for (int j = 0; j < degree; j++) {
+                unsigned long long* target = reached.data() + (size_t)neighbours[j] * words;
+                if (words >= vectorWords) {
+                    orWords(target, set, words);
+                } else {
+                    for (int w = 0; w < words; w++) {
+                        target[w] |= set[w];
+                    }
                 }
             }
         }
@@ -175,9 +1521,11 @@ void computeSizesOfSCC(const int& N, const std::vector<int>& SCC, std::vector<in
     }
 }
 
-void computeMaxPath(std::vector<int>& maxPathDP, const int& P, const std::vector<int>& SCC, const std::vector<int>& sizesOfSCC, const int& numSCC, const std::vector<std::vector<int>>& adjacencyListSCCReverse, const std::vector<int>& reachableFromStarts, const int& A) {
+template<class Graph>
+void computeMaxPath(std::vector<int>& maxPathDP, const int& P, const std::vector<int>& SCC, const std::vector<int>& sizesOfSCC, const int& numSCC, const Graph& adjacencyListSCCReverse, const std::vector<int>& reachableFromStarts, const int& A) {
     // Set value for goal node
     maxPathDP[SCC[P]] = sizesOfSCC[SCC[P]];
+    std::vector<int> buffer;
     
     // For each node 
     for(size_t i = numSCC; i > 0; i--) {
@@ -186,8 +1534,9 @@ void computeMaxPath(std::vector<int>& maxPathDP, const int& P, const std::vector
             continue;
         }
 
-        std::vector<int> neighbours = adjacencyListSCCReverse[i];
-        for(size_t j = 0; j < neighbours.size(); j++) {
+        int degree;
+        const int* neighbours = adjacencyListSCCReverse.neighbourArray(i, buffer, degree);
+        for(int j = 0; j < degree; j++) {
             int neighbour = neighbours[j];
             // Check if node is reachable by all starting nodes
             if(reachableFromStarts[neighbour] == A) {
@@ -217,46 +1566,29 @@ void printVector(std::vector<int> vec) {
     std::cout << std::endl;
 }
 
-/* MAIN */
-int main() {
-    // N - number of sites
-    // M - number of direct routes
-    // A - number of archeologist 
-    // P - the primary excavation site
-    int N, M, A, P;
-    
-    // Load first line of input data
-    std::cin >> N >> M >> A >> P;
-
-    std::vector<int> starts(A);
-    std::vector<std::tuple<int, int>> edges;
-    edges.reserve(M);
-    
-    // Load ids of nodes where archeologist start 
-    loadStarts(starts, A);
-
-    // Load edges
-    loadInputEdges(edges, M);
-
-    // Transform edges to adjacency list
-    std::vector<std::vector<int>> adjacencyList(N + 1);
-    std::vector<std::vector<int>> adjacencyListReverse(N + 1);
-    createAdjacencyList(adjacencyList, adjacencyListReverse, edges, M);
-
+template<class Graph>
+int computeMaxValueOnGraph(const Graph& adjacencyList, const Graph& adjacencyListReverse, const std::vector<int>& starts, const int N, const int A, const int P, PhaseReport& report) {
     // Kosaraju-Sharir Algorithm for finding SCC
+    report.start("scc");
     int numSCC = 0;
     std::vector<int> SCC(N + 1);
     kosarajuSharirAlgorithm(adjacencyList, adjacencyListReverse, N, SCC, numSCC);
+    report.stop();
     
     // Create condensed graph 
-    std::vector<std::vector<int>> adjacencyListSCC(numSCC + 1);
-    std::vector<std::vector<int>> adjacencyListSCCReverse(numSCC + 1);
-    createAdjacencyListSCC(adjacencyList, SCC, adjacencyListSCC, adjacencyListSCCReverse, N, numSCC);
+    report.start("condense");
+    Graph adjacencyListSCC;
+    Graph adjacencyListSCCReverse;
+    createAdjacencyListSCC(adjacencyList, adjacencyListReverse, SCC, adjacencyListSCC, adjacencyListSCCReverse, N, numSCC);
+    report.stop();
 
     // Compute for each component of SCC graph is reachable by all nodes from start
+    report.start("reach");
     std::vector<int> reachableFromStarts(numSCC + 1);
     getReachableCompsFromStarts(starts, SCC, adjacencyListSCC, reachableFromStarts, numSCC, A);
+    report.stop();
     
+    report.start("path");
     // Compute size of each strongly connected component in condensed graph
     std::vector<int> sizesOfSCC(numSCC + 1);
     computeSizesOfSCC(N, SCC, sizesOfSCC);
@@ -268,8 +1600,174 @@ int main() {
     // Select max value from all starts nodes, nodes that are in SCC components, using DP table
     int maxValue = 0;
     selectMaxValue(maxValue, A, starts, SCC, maxPathDP);
+    report.stop();
+
+    return maxValue;
+}
+
+int computeMaxValue(EdgeList& edges, const std::vector<int>& starts, const int N, const int M, const int A, const int P, bool compress, bool releaseEdges, PhaseReport& report, FlatAdjacencyList* streamedAdjacencyList = nullptr, FlatAdjacencyList* streamedAdjacencyListReverse = nullptr) {
+    // Edges are freed once the adjacency lists are built when the caller does not need them any more
+    size_t flatBytes = (2 * (size_t)(N + 2) + 2 * (size_t)M) * sizeof(int);
+    if (!compress) {
+        // Transform edges to adjacency list, unless it was already built while loading
+        report.start("adjacency");
+        FlatAdjacencyList adjacencyList;
+        FlatAdjacencyList adjacencyListReverse;
+        if (streamedAdjacencyList != nullptr) {
+            std::swap(adjacencyList, *streamedAdjacencyList);
+            std::swap(adjacencyListReverse, *streamedAdjacencyListReverse);
+        } else {
+            createAdjacencyList(adjacencyList, adjacencyListReverse, edges, N);
+        }
+        if (releaseEdges) {
+            EdgeList().swap(edges);
+        }
+        report.stop();
+        return computeMaxValueOnGraph(adjacencyList, adjacencyListReverse, starts, N, A, P, report);
+    }
+
+    // Time the flat graph on the same input first, so the report can compare both representations
+    double flatMs = 0;
+    if (report.isEnabled()) {
+        // Phases of the inner run go to their own report, starting them would reset the outer timer
+        PhaseReport timing(false);
+        PhaseReport phases(false);
+        FlatAdjacencyList adjacencyList;
+        FlatAdjacencyList adjacencyListReverse;
+        const FlatAdjacencyList& flat = streamedAdjacencyList != nullptr ? *streamedAdjacencyList : adjacencyList;
+        const FlatAdjacencyList& flatReverse = streamedAdjacencyList != nullptr ? *streamedAdjacencyListReverse : adjacencyListReverse;
+        if (streamedAdjacencyList == nullptr) {
+            createAdjacencyList(adjacencyList, adjacencyListReverse, edges, N);
+        }
+        timing.start("flat");
+        computeMaxValueOnGraph(flat, flatReverse, starts, N, A, P, phases);
+        flatMs = timing.stop();
+    }
+
+    // Flat lists are converted one after the other and freed, edges are freed before the traversal
+    // when the caller does not need them
+    report.start("compress");
+    CompressedAdjacencyList compressedList;
+    CompressedAdjacencyList compressedListReverse;
+    if (streamedAdjacencyList != nullptr) {
+        convertAdjacencyList(*streamedAdjacencyList, compressedList);
+        convertAdjacencyList(*streamedAdjacencyListReverse, compressedListReverse);
+    } else {
+        compressEdges(edges, N, false, compressedList);
+        compressEdges(edges, N, true, compressedListReverse);
+        if (releaseEdges) {
+            EdgeList().swap(edges);
+        }
+    }
+    report.stop();
+
+    PhaseReport timing(false);
+    timing.start("compressed");
+    int maxValue = computeMaxValueOnGraph(compressedList, compressedListReverse, starts, N, A, P, report);
+    double compressedMs = timing.stop();
+
+    if (report.isEnabled()) {
+        size_t compressedBytes = compressedList.memoryBytes() + compressedListReverse.memoryBytes();
+        report.note("compress: adjacency " + std::to_string(flatBytes >> 10) + " KiB flat, " + std::to_string(compressedBytes >> 10)
+            + " KiB compressed (" + std::to_string((double)flatBytes / std::max<size_t>(compressedBytes, 1)) + "x), traversal "
+            + std::to_string(flatMs) + " ms flat, " + std::to_string(compressedMs) + " ms compressed");
+    }
+
+    return maxValue;
+}
+
+/* MAIN */
+int main() {
+    // N - number of sites
+    // M - number of direct routes
+    // A - number of archeologist 
+    // P - the primary excavation site
+    int N, M, A, P;
+    
+    // Load first line of input data
+    std::cin >> N >> M >> A >> P;
+
+    std::vector<int> starts(A);
+    EdgeList edges;
+    
+    // Load ids of nodes where archeologist start 
+    loadStarts(starts, A);
+
+    PhaseReport report(std::getenv("PAL_REPORT") != nullptr);
+
+    // Optionally relabel nodes, so the traversal touches memory in order
+    const char* nodeOrder = std::getenv("PAL_REORDER");
+    bool reorder = nodeOrder != nullptr && *nodeOrder != '\0';
+
+    // Optionally keep the graph as varint deltas of sorted neighbours, for graphs that do not fit in memory otherwise
+    bool compress = std::getenv("PAL_COMPRESS") != nullptr;
+
+    // Load edges, either in parallel chunks or streamed straight into the adjacency lists
+    // (relabelling needs the edge list, so streaming is used only without reordering)
+    FlatAdjacencyList streamedAdjacencyList;
+    FlatAdjacencyList streamedAdjacencyListReverse;
+    bool pipeline = std::getenv("PAL_PIPELINE") != nullptr && !reorder;
+    if (pipeline) {
+        report.start("parse+build");
+        streamAdjacencyList(streamedAdjacencyList, streamedAdjacencyListReverse, N, M);
+    } else {
+        report.start("parse");
+        edges.reserve(M);
+        loadInputEdges(edges, M);
+    }
+    report.stop();
+
+    std::vector<int> newId;
+    std::vector<int> originalStarts = starts;
+    int originalP = P;
+    if (reorder) {
+        report.start("reorder");
+        FlatAdjacencyList adjacencyList;
+        FlatAdjacencyList adjacencyListReverse;
+        createAdjacencyList(adjacencyList, adjacencyListReverse, edges, N);
+        newId = computeNodeOrder(adjacencyList, adjacencyListReverse, N, nodeOrder);
+        if (!newId.empty()) {
+            relabelEdges(edges, newId);
+            for (int i = 0; i < A; i++) {
+                starts[i] = newId[starts[i]];
+            }
+            P = newId[P];
+        }
+        report.stop();
+    }
+
+    // The answer is a number of sites, so it does not depend on node ids and needs no mapping back.
+    // Edges are needed again only by the timing runs below
+    bool timeReorder = !newId.empty() && report.isEnabled();
+    int maxValue = computeMaxValue(edges, starts, N, M, A, P, compress, !timeReorder, report,
+        pipeline ? &streamedAdjacencyList : nullptr, pipeline ? &streamedAdjacencyListReverse : nullptr);
+
+    if (timeReorder) {
+        // Time the traversal again in both orders (with warm allocator and caches) to see what reordering saved
+        // Inner phases go to their own report, starting them would reset the outer timer
+        PhaseReport timing(false);
+        PhaseReport phases(false);
+        timing.start("reordered");
+        computeMaxValue(edges, starts, N, M, A, P, compress, false, phases);
+        double reorderedMs = timing.stop();
+
+        std::vector<int> oldId(N + 1);
+        for (int i = 1; i <= N; i++) {
+            oldId[newId[i]] = i;
+        }
+        relabelEdges(edges, oldId);
+        timing.start("original");
+        computeMaxValue(edges, originalStarts, N, M, A, originalP, compress, false, phases);
+        double originalMs = timing.stop();
+
+        report.note("reorder " + std::string(nodeOrder) + ": spent " + std::to_string(report.total("reorder"))
+            + " ms, saved " + std::to_string(originalMs - reorderedMs) + " ms per traversal (" + std::to_string(originalMs)
+            + " ms original order, " + std::to_string(reorderedMs) + " ms reordered)");
+    }
 
     std::cout << maxValue << std::endl;
 
+    report.print();
+
     return 0;
 }
\ No newline at end of file
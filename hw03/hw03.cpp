@@ -1,6 +1,15 @@
 #include <iostream>
 #include <vector>
 #include <tuple>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 void loadInputEdges(std::vector<std::tuple<int, int, int>>& edgesCTU, std::vector<std::vector<int>>& cableTypesCTU, const int& M) {
     for (int i = 0; i < M; i++) {
@@ -64,11 +73,662 @@ void printAdjacencyList(const std::vector<std::vector<std::tuple<int, int>>>& ad
     }
 }
 
-bool checkPossibleMapping(int node, int candidate, std::vector<std::vector<std::tuple<int, int>>> compAdjList, std::vector<std::vector<int>> cableTypesCTU, std::vector<int> assigned) {
+void createCableList(const std::vector<std::vector<int>>& cableTypesCTU, int N, std::vector<std::vector<std::tuple<int, int>>>& cableList) {
+    // (neighbour, type) of every CTU server, from the matrix so a cable listed twice counts once
+    cableList.assign(N, std::vector<std::tuple<int, int>>());
+    for (int n1 = 0; n1 < N; n1++) {
+        for (int n2 = 0; n2 < N; n2++) {
+            if (cableTypesCTU[n1][n2] != 0) {
+                cableList[n1].emplace_back(n2, cableTypesCTU[n1][n2]);
+            }
+        }
+    }
+}
+
+unsigned long long mixHash(unsigned long long x) {
+    // splitmix64 finaliser, spreads (colour, cable type) pairs over the whole word
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+int refineColours(std::vector<int>& colours, const std::vector<std::vector<std::tuple<int, int>>>& cableList, long long& workLeft) {
+    // Refines a colouring of the CTU network until no cell splits any more and returns the number of colours.
+    // Signature of a node is its colour and a sum of hashes of (colour, cable type) of its neighbours, new colours
+    // are ranks of sorted signatures, so the same partition always gets the same colours and cells only split.
+    // Equal signatures always hash equally, a collision can only keep two cells together.
+    int N = colours.size();
+    int numColours = N > 0 ? *std::max_element(colours.begin(), colours.end()) + 1 : 0;
+    std::vector<std::tuple<int, unsigned long long, int>> signatures(N);
+
+    while (true) {
+        for (int node = 0; node < N; node++) {
+            unsigned long long hash = 0;
+            for (size_t i = 0; i < cableList[node].size(); i++) {
+                int other, type;
+                std::tie(other, type) = cableList[node][i];
+                hash += mixHash(((unsigned long long)colours[other] << 32) | (unsigned int)type);
+            }
+            signatures[node] = std::make_tuple(colours[node], hash, node);
+            workLeft -= cableList[node].size() + 1;
+        }
+        std::sort(signatures.begin(), signatures.end());
+
+        int newNumColours = 0;
+        for (int i = 0; i < N; i++) {
+            if (i > 0 && (std::get<0>(signatures[i]) != std::get<0>(signatures[i - 1]) || std::get<1>(signatures[i]) != std::get<1>(signatures[i - 1]))) {
+                newNumColours++;
+            }
+            colours[std::get<2>(signatures[i])] = newNumColours;
+        }
+        newNumColours++;
+
+        if (newNumColours == numColours) {
+            return numColours;
+        }
+        numColours = newNumColours;
+    }
+}
+
+int firstNonSingletonCell(const std::vector<int>& colours, int numColours, std::vector<int>& cellSize) {
+    // Target cell of the search tree: lowest colour shared by more than one node, -1 for a discrete colouring
+    cellSize.assign(numColours, 0);
+    for (size_t node = 0; node < colours.size(); node++) {
+        cellSize[colours[node]]++;
+    }
+    for (int c = 0; c < numColours; c++) {
+        if (cellSize[c] > 1) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+struct AutomorphismSearch {
+    int N;
+    const std::vector<std::vector<std::tuple<int, int>>>* cableList;
+    const std::vector<std::vector<int>>* cableTypesCTU;
+    std::vector<std::vector<int>> pathCellSizes;    // cell sizes after every level of the first path
+    std::vector<int> firstLeaf;                     // node with colour c in the first leaf
+    long long workLeft;                             // neighbour visits left before the search gives up
+};
+
+int individualise(std::vector<int>& colours, int node, AutomorphismSearch& search) {
+    // Give the node a colour of its own and refine the rest of the colouring around it
+    colours[node] = *std::max_element(colours.begin(), colours.end()) + 1;
+    return refineColours(colours, *search.cableList, search.workLeft);
+}
+
+bool findAutomorphism(int depth, const std::vector<int>& colours, int numColours, AutomorphismSearch& search, std::vector<int>& permutation) {
+    // Searches the subtree below a refined colouring for a leaf equivalent to the first leaf, the colourings on
+    // the way must have the same cell sizes as the first path on the same level
+    std::vector<int> cellSize;
+    int target = firstNonSingletonCell(colours, numColours, cellSize);
+    if (depth >= (int)search.pathCellSizes.size() || cellSize != search.pathCellSizes[depth]) {
+        return false;
+    }
+
+    if (target == -1) {
+        // Discrete colouring, the only candidate maps the node of every colour in the first leaf to this one
+        permutation.assign(search.N, -1);
+        for (int node = 0; node < search.N; node++) {
+            permutation[search.firstLeaf[colours[node]]] = node;
+        }
+        for (int n1 = 0; n1 < search.N; n1++) {
+            for (size_t i = 0; i < (*search.cableList)[n1].size(); i++) {
+                int n2, type;
+                std::tie(n2, type) = (*search.cableList)[n1][i];
+                if ((*search.cableTypesCTU)[permutation[n1]][permutation[n2]] != type) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    for (int node = 0; node < search.N && search.workLeft > 0; node++) {
+        if (colours[node] != target) {
+            continue;
+        }
+        std::vector<int> individualised = colours;
+        int individualisedColours = individualise(individualised, node, search);
+        if (findAutomorphism(depth + 1, individualised, individualisedColours, search, permutation)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int findOrbit(std::vector<int>& orbitParent, int node) {
+    if (orbitParent[node] != node) {
+        orbitParent[node] = findOrbit(orbitParent, orbitParent[node]);
+    }
+    return orbitParent[node];
+}
+
+void computeAutomorphisms(const std::vector<std::vector<int>>& cableTypesCTU, const std::vector<std::vector<std::tuple<int, int>>>& cableList, int N, std::vector<std::vector<int>>& generators) {
+    // Generators of the automorphism group of the CTU network from one individualisation-refinement search tree.
+    // The first path always individualises the lowest node of the target cell, then from the deepest level up
+    // every other node of the cell that is not yet in the orbit of the path node (or of one that already failed)
+    // is tried, and a leaf equivalent to the first leaf gives a new generator. Every generator fixes the path
+    // above its level, so the orbits on each level are orbits of the right stabiliser. When the work bound runs
+    // out the generators found so far are kept: they still are automorphisms, only fewer branches get pruned.
+    AutomorphismSearch search;
+    search.N = N;
+    search.cableList = &cableList;
+    search.cableTypesCTU = &cableTypesCTU;
+    search.workLeft = 30000000;
+
+    // Servers without cables never take part in a scheme, each of them starts in a cell of its own
+    std::vector<int> colours(N, 0);
+    int isolated = 0;
+    for (int node = 0; node < N; node++) {
+        if (cableList[node].empty()) {
+            colours[node] = ++isolated;
+        }
+    }
+
+    // First path down to a discrete colouring
+    int numColours = refineColours(colours, cableList, search.workLeft);
+    std::vector<std::vector<int>> pathColours;
+    std::vector<int> pathNodes;
+    while (search.workLeft > 0) {
+        std::vector<int> cellSize;
+        int target = firstNonSingletonCell(colours, numColours, cellSize);
+        pathColours.push_back(colours);
+        search.pathCellSizes.push_back(cellSize);
+        if (target == -1) {
+            break;
+        }
+        int node = std::find(colours.begin(), colours.end(), target) - colours.begin();
+        pathNodes.push_back(node);
+        numColours = individualise(colours, node, search);
+    }
+    if (search.workLeft <= 0) {
+        return;
+    }
+    search.firstLeaf.assign(N, -1);
+    for (int node = 0; node < N; node++) {
+        search.firstLeaf[colours[node]] = node;
+    }
+
+    std::vector<int> orbitParent(N);
+    for (int node = 0; node < N; node++) {
+        orbitParent[node] = node;
+    }
+    for (int level = (int)pathNodes.size() - 1; level >= 0 && search.workLeft > 0; level--) {
+        const std::vector<int>& levelColours = pathColours[level];
+        int pathNode = pathNodes[level];
+        std::vector<int> failed;
+        for (int node = 0; node < N && search.workLeft > 0; node++) {
+            if (levelColours[node] != levelColours[pathNode] || findOrbit(orbitParent, node) == findOrbit(orbitParent, pathNode)) {
+                continue;
+            }
+            bool knownToFail = false;
+            for (size_t i = 0; i < failed.size() && !knownToFail; i++) {
+                knownToFail = findOrbit(orbitParent, node) == findOrbit(orbitParent, failed[i]);
+            }
+            if (knownToFail) {
+                continue;
+            }
+
+            // Twins (same cables to everything else) are swapped directly, without a search below them
+            bool twins = true;
+            for (int other = 0; other < N && twins; other++) {
+                twins = other == node || other == pathNode || cableTypesCTU[node][other] == cableTypesCTU[pathNode][other];
+            }
+            search.workLeft -= N;
+
+            std::vector<int> permutation;
+            if (twins) {
+                permutation.resize(N);
+                for (int other = 0; other < N; other++) {
+                    permutation[other] = other;
+                }
+                std::swap(permutation[node], permutation[pathNode]);
+            }
+            std::vector<int> individualised = levelColours;
+            if (twins || findAutomorphism(level + 1, individualised, individualise(individualised, node, search), search, permutation)) {
+                generators.push_back(permutation);
+                for (int other = 0; other < N; other++) {
+                    orbitParent[findOrbit(orbitParent, other)] = findOrbit(orbitParent, permutation[other]);
+                }
+            } else {
+                failed.push_back(node);
+            }
+        }
+    }
+}
+
+void computeCandidateOrbits(const std::vector<std::vector<int>>& generators, const std::vector<bool>& used, std::vector<int>& orbitOf) {
+    // Orbits of the automorphisms that keep every already used CTU node in place
+    int N = used.size();
+    orbitOf.resize(N);
+    for (int node = 0; node < N; node++) {
+        orbitOf[node] = node;
+    }
+
+    for (size_t g = 0; g < generators.size(); g++) {
+        const std::vector<int>& permutation = generators[g];
+        bool fixesUsed = true;
+        for (int node = 0; node < N && fixesUsed; node++) {
+            fixesUsed = !used[node] || permutation[node] == node;
+        }
+        if (!fixesUsed) {
+            continue;
+        }
+        for (int node = 0; node < N; node++) {
+            orbitOf[findOrbit(orbitOf, node)] = findOrbit(orbitOf, permutation[node]);
+        }
+    }
+
+    for (int node = 0; node < N; node++) {
+        findOrbit(orbitOf, node);
+    }
+}
+
+// Word-wise dst &= src and dst |= src over n words of a bitset
+void andWordsScalar(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] &= src[i];
+    }
+}
+
+void orWordsScalar(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] |= src[i];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2")))
+void andWordsSse42(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_and_si128(_mm_loadu_si128((const __m128i*)(dst + i)), _mm_loadu_si128((const __m128i*)(src + i)));
+        _mm_storeu_si128((__m128i*)(dst + i), x);
+    }
+    andWordsScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse4.2")))
+void orWordsSse42(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_or_si128(_mm_loadu_si128((const __m128i*)(dst + i)), _mm_loadu_si128((const __m128i*)(src + i)));
+        _mm_storeu_si128((__m128i*)(dst + i), x);
+    }
+    orWordsScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void andWordsAvx2(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(dst + i)), _mm256_loadu_si256((const __m256i*)(src + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), x);
+    }
+    andWordsScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void orWordsAvx2(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(dst + i)), _mm256_loadu_si256((const __m256i*)(src + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), x);
+    }
+    orWordsScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void andWordsAvx512(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_si512(dst + i, _mm512_and_si512(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+    }
+    andWordsScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void orWordsAvx512(unsigned long long* dst, const unsigned long long* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_si512(dst + i, _mm512_or_si512(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+    }
+    orWordsScalar(dst + i, src + i, n - i);
+}
+#endif
+
+// Vectorised kernels, compiled for several instruction sets and picked once at start-up from the CPU,
+// PAL_SIMD (scalar, sse4.2, avx2, avx512) forces a level, a level the CPU lacks falls back to the best one it has
+struct SimdKernels {
+    enum Level { SCALAR, SSE42, AVX2, AVX512 };
+
+    Level level = SCALAR;
+    void (*andWords)(unsigned long long* dst, const unsigned long long* src, size_t n) = andWordsScalar;
+    void (*orWords)(unsigned long long* dst, const unsigned long long* src, size_t n) = orWordsScalar;
+
+    static const char* levelName(Level level) {
+        const char* names[] = {"scalar", "sse4.2", "avx2", "avx512"};
+        return names[level];
+    }
+
+    SimdKernels() {
+        Level best = SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2")) {
+            best = SSE42;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            best = AVX2;
+        }
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+            best = AVX512;
+        }
+#endif
+        level = best;
+        const char* simdEnv = std::getenv("PAL_SIMD");
+        if (simdEnv != nullptr) {
+            for (int i = SCALAR; i <= AVX512; i++) {
+                if (std::string(simdEnv) == levelName((Level)i)) {
+                    level = std::min(best, (Level)i);
+                }
+            }
+        }
+
+#if defined(__x86_64__) || defined(__i386__)
+        if (level == SSE42) {
+            andWords = andWordsSse42;
+            orWords = orWordsSse42;
+        } else if (level == AVX2) {
+            andWords = andWordsAvx2;
+            orWords = orWordsAvx2;
+        } else if (level == AVX512) {
+            andWords = andWordsAvx512;
+            orWords = orWordsAvx512;
+        }
+#endif
+    }
+
+    static const SimdKernels& get() {
+        static SimdKernels kernels;
+        return kernels;
+    }
+};
+
+// Set of CTU servers as a bitset
+class NodeSet {
+private:
+    std::vector<unsigned long long> words;
+
+    static const size_t vectorWords = 4;
+
+public:
+    NodeSet(int size = 0) : words((size + 63) / 64, 0) {}
+
+    void set(int node) {
+        words[node >> 6] |= 1ULL << (node & 63);
+    }
+
+    void reset(int node) {
+        words[node >> 6] &= ~(1ULL << (node & 63));
+    }
+
+    bool test(int node) const {
+        return (words[node >> 6] >> (node & 63)) & 1;
+    }
+
+    int count() const {
+        int res = 0;
+        for (size_t i = 0; i < words.size(); i++) {
+            res += __builtin_popcountll(words[i]);
+        }
+        return res;
+    }
+
+    bool empty() const {
+        for (size_t i = 0; i < words.size(); i++) {
+            if (words[i] != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void intersectWith(const NodeSet& other) {
+        // A call through the kernel pointer costs more than a few words save
+        if (words.size() >= vectorWords) {
+            SimdKernels::get().andWords(words.data(), other.words.data(), words.size());
+            return;
+        }
+        for (size_t i = 0; i < words.size(); i++) {
+            words[i] &= other.words[i];
+        }
+    }
+
+    void uniteWith(const NodeSet& other) {
+        if (words.size() >= vectorWords) {
+            SimdKernels::get().orWords(words.data(), other.words.data(), words.size());
+            return;
+        }
+        for (size_t i = 0; i < words.size(); i++) {
+            words[i] |= other.words[i];
+        }
+    }
+
+    // First node in the set that is >= from, -1 if there is none
+    int next(int from) const {
+        size_t i = from >> 6;
+        if (i >= words.size()) {
+            return -1;
+        }
+        unsigned long long word = words[i] & (~0ULL << (from & 63));
+        while (word == 0) {
+            if (++i == words.size()) {
+                return -1;
+            }
+            word = words[i];
+        }
+        return i * 64 + __builtin_ctzll(word);
+    }
+
+    bool operator==(const NodeSet& other) const {
+        return words == other.words;
+    }
+};
+
+// Everything the search of one scheme reads but never changes
+struct SchemeSearch {
+    int N;
+    std::vector<int> order;                                         // servers with cables, the ones to map
+    std::vector<std::vector<std::tuple<int, int>>> compAdjList;    // CTU cables (neighbour, type required by the scheme, 0 any)
+    const std::vector<std::vector<int>>* cableTypesCTU;
+    const std::vector<std::vector<NodeSet>>* cableNeighbours;      // [server][type] CTU neighbours by that cable type, [0] by any
+    const std::vector<int>* untypedColours;                         // colours of the CTU network without cable types
+    const std::vector<std::vector<int>>* generators;               // CTU automorphisms
+};
+
+void computeCableNeighbours(const std::vector<std::vector<int>>& cableTypesCTU, int N, int maxType, std::vector<std::vector<NodeSet>>& cableNeighbours) {
+    cableNeighbours.assign(N, std::vector<NodeSet>(maxType + 1, NodeSet(N)));
+    for(int n1 = 0; n1 < N; n1++) {
+        for(int n2 = 0; n2 < N; n2++) {
+            if(cableTypesCTU[n1][n2] != 0) {
+                cableNeighbours[n1][cableTypesCTU[n1][n2]].set(n2);
+                cableNeighbours[n1][0].set(n2);
+            }
+        }
+    }
+}
+
+void computeInitialDomains(const SchemeSearch& search, int maxType, std::vector<NodeSet>& domains) {
+    // A server can only map to a CTU server of the same untyped colour with at least as many cables of every
+    // type the scheme asks for
+    int N = search.N;
+    domains.assign(N, NodeSet(N));
+    for(int node = 0; node < N; node++) {
+        std::vector<int> neededCables(maxType + 1, 0);
+        for(size_t i = 0; i < search.compAdjList[node].size(); i++) {
+            neededCables[std::get<1>(search.compAdjList[node][i])]++;
+        }
+        for(int candidate = 0; candidate < N; candidate++) {
+            bool fits = (*search.untypedColours)[candidate] == (*search.untypedColours)[node];
+            for(int type = 1; type <= maxType && fits; type++) {
+                fits = neededCables[type] <= (*search.cableNeighbours)[candidate][type].count();
+            }
+            if(fits) {
+                domains[node].set(candidate);
+            }
+        }
+    }
+}
+
+bool propagateDomains(const SchemeSearch& search, std::vector<NodeSet>& domains, const std::vector<int>& assigned, std::vector<int> changed) {
+    // AC-3: every candidate of a server needs a candidate of each cabled neighbour connected by the same cable type
+    std::vector<bool> queued(search.N, false);
+    for(size_t i = 0; i < changed.size(); i++) {
+        queued[changed[i]] = true;
+    }
+
+    while(!changed.empty()) {
+        int node = changed.back();
+        changed.pop_back();
+        queued[node] = false;
+
+        for(size_t i = 0; i < search.compAdjList[node].size(); i++) {
+            int neighbour = std::get<0>(search.compAdjList[node][i]);
+            int cableType = std::get<1>(search.compAdjList[node][i]);
+            if(assigned[neighbour] != -1) {
+                continue;
+            }
+
+            // Cables are symmetric, so the candidates with such a cable to the domain of node are the union of
+            // the cable neighbours of that domain
+            NodeSet supported(search.N);
+            for(int candidate = domains[node].next(0); candidate != -1; candidate = domains[node].next(candidate + 1)) {
+                supported.uniteWith((*search.cableNeighbours)[candidate][cableType]);
+            }
+            NodeSet revised = domains[neighbour];
+            revised.intersectWith(supported);
+            if(revised == domains[neighbour]) {
+                continue;
+            }
+            if(revised.empty()) {
+                return false;
+            }
+            domains[neighbour] = revised;
+            if(!queued[neighbour]) {
+                queued[neighbour] = true;
+                changed.push_back(neighbour);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool findAugmentingPath(int node, const std::vector<NodeSet>& domains, std::vector<int>& matchOf, std::vector<int>& matchedBy, NodeSet& visited) {
+    for(int candidate = domains[node].next(0); candidate != -1; candidate = domains[node].next(candidate + 1)) {
+        if(visited.test(candidate)) {
+            continue;
+        }
+        visited.set(candidate);
+        if(matchedBy[candidate] == -1 || findAugmentingPath(matchedBy[candidate], domains, matchOf, matchedBy, visited)) {
+            matchOf[node] = candidate;
+            matchedBy[candidate] = node;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool hasInjectiveMapping(const SchemeSearch& search, const std::vector<NodeSet>& domains, std::vector<int>& matchOf) {
+    // All-different check: scheme servers and their domains need a matching covering every scheme server,
+    // the matching of the parent search node is kept where still valid and only broken pairs are augmented
+    std::vector<int> matchedBy(search.N, -1);
+    for(size_t i = 0; i < search.order.size(); i++) {
+        int node = search.order[i];
+        if(matchOf[node] != -1 && (!domains[node].test(matchOf[node]) || matchedBy[matchOf[node]] != -1)) {
+            matchOf[node] = -1;
+        }
+        if(matchOf[node] != -1) {
+            matchedBy[matchOf[node]] = node;
+        }
+    }
+
+    for(size_t i = 0; i < search.order.size(); i++) {
+        int node = search.order[i];
+        if(matchOf[node] != -1) {
+            continue;
+        }
+        NodeSet visited(search.N);
+        if(!findAugmentingPath(node, domains, matchOf, matchedBy, visited)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// What the search of one scheme did, exported as JSON when PAL_STATS is set
+struct SearchStats {
+    long long nodesExpanded = 0;
+    long long candidatesTried = 0;
+    long long prunedUsed = 0;           // candidate already mapped to another server
+    long long prunedSymmetry = 0;       // symmetric candidate already failed
+    long long prunedCable = 0;          // cable to a mapped neighbour does not match
+    long long prunedPropagation = 0;    // some domain became empty
+    long long prunedMatching = 0;       // no injective mapping of the remaining servers
+    int maxDepth = 0;
+    double timeMs = 0;
+    bool outOfBudget = false;
+
+    // Budget per scheme, 0 means unlimited
+    long long nodeBudget = 0;
+    double timeBudgetMs = 0;
+    std::chrono::steady_clock::time_point start;
+
+    bool checkBudget() {
+        if (nodeBudget > 0 && nodesExpanded > nodeBudget) {
+            outOfBudget = true;
+        }
+        // Reading the clock on every node would cost more than the node itself
+        if (timeBudgetMs > 0 && (nodesExpanded & 255) == 0
+            && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > timeBudgetMs) {
+            outOfBudget = true;
+        }
+        return !outOfBudget;
+    }
+};
+
+void printStatsJson(std::ostream& out, const std::vector<SearchStats>& stats, const std::vector<int>& results) {
+    const char* resultNames[] = {"no", "yes", "unknown"};
+    out << "[" << std::endl;
+    for (size_t i = 0; i < stats.size(); i++) {
+        const SearchStats& st = stats[i];
+        out << "  {\"scheme\": " << i + 1
+            << ", \"result\": \"" << resultNames[results[i]] << "\""
+            << ", \"nodesExpanded\": " << st.nodesExpanded
+            << ", \"candidatesTried\": " << st.candidatesTried
+            << ", \"pruned\": {\"used\": " << st.prunedUsed
+            << ", \"symmetry\": " << st.prunedSymmetry
+            << ", \"cable\": " << st.prunedCable
+            << ", \"propagation\": " << st.prunedPropagation
+            << ", \"matching\": " << st.prunedMatching << "}"
+            << ", \"maxDepth\": " << st.maxDepth
+            << ", \"timeMs\": " << st.timeMs << "}"
+            << (i + 1 < stats.size() ? "," : "") << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+bool checkPossibleMapping(int node, int candidate, const std::vector<std::vector<std::tuple<int, int>>>& compAdjList, const std::vector<std::vector<int>>& cableTypesCTU, const std::vector<int>& assigned) {
     int res = true;
     
     // [(neighbour1, cable), (neighbour2, cable), (neighbour3, cable), ...]
-    std::vector<std::tuple<int, int>> nodeNeighbours = compAdjList[node];
+    const std::vector<std::tuple<int, int>>& nodeNeighbours = compAdjList[node];
     for(int i = 0; i < nodeNeighbours.size(); i++) {
         std::tuple<int, int> neighbourElement = nodeNeighbours[i];
         int neighbour = std::get<0>(neighbourElement);
@@ -81,8 +741,8 @@ bool checkPossibleMapping(int node, int candidate, std::vector<std::vector<std::
         }
 
         int mappedCableType = cableTypesCTU[candidate][neighbourMapped];
-        if(mappedCableType != cableType) {
-            // The mapped node suits the cable condition
+        if(mappedCableType == 0 || (cableType != 0 && mappedCableType != cableType)) {
+            // The mapped node does not suit the cable condition
             res = false;
         }
     }
@@ -90,53 +750,88 @@ bool checkPossibleMapping(int node, int candidate, std::vector<std::vector<std::
     return res;
 }
 
-bool checkScheme(int depth, int N, std::vector<std::vector<int>> candidates, std::vector<std::vector<std::tuple<int, int>>> compAdjList, std::vector<std::vector<int>> cableTypesCTU, std::vector<int> assigned, std::vector<bool> used) {
-    std::cout << "Running for node: " << depth << std::endl;
+bool checkScheme(int depth, const SchemeSearch& search, const std::vector<NodeSet>& domains, const std::vector<int>& matchOf, std::vector<int>& assigned, std::vector<bool>& used, SearchStats& stats) {
+    stats.nodesExpanded++;
+    stats.maxDepth = std::max(stats.maxDepth, depth);
+    if(!stats.checkBudget()) {
+        // Give up, the caller reports the scheme as unknown
+        return false;
+    }
     
-    if(depth == N) {
-        // std::cout << "Super" << std::endl;
+    if(depth == (int)search.order.size()) {
         return true;
     }
     
     bool res = false;
-    int node = depth;
-    std::vector<int> candidatesForNode = candidates[node];
+
+    // Map the server with the fewest candidates left first, so dead branches fail early
+    int node = -1;
+    for(size_t i = 0; i < search.order.size(); i++) {
+        int candidateNode = search.order[i];
+        if(assigned[candidateNode] == -1 && (node == -1 || domains[candidateNode].count() < domains[node].count())) {
+            node = candidateNode;
+        }
+    }
+
+    // Candidates in one orbit of automorphisms fixing the used nodes lead to the same result, try each orbit once
+    std::vector<int> orbitOf;
+    computeCandidateOrbits(*search.generators, used, orbitOf);
+    std::vector<bool> orbitFailed(used.size(), false);
     
-    for(int i = 0; i < candidatesForNode.size(); i++) {
-        std::cout << "Running for node: " << depth << " I: " << i << std::endl;
-        int candidate = candidatesForNode[i];
+    for(int candidate = domains[node].next(0); candidate != -1; candidate = domains[node].next(candidate + 1)) {
+        stats.candidatesTried++;
         if(used[candidate] == true) {
             // If candidate is already assign continue
+            stats.prunedUsed++;
+            continue;
+        }
+        if(orbitFailed[orbitOf[candidate]] == true) {
+            // Symmetric candidate already failed
+            stats.prunedSymmetry++;
             continue;
         }
 
-        bool isMapPossible = checkPossibleMapping(node, candidate, compAdjList, cableTypesCTU, assigned);
+        bool isMapPossible = checkPossibleMapping(node, candidate, search.compAdjList, *search.cableTypesCTU, assigned);
 
         if(isMapPossible) {
-            // std::cout << "Map is possible" << std::endl;
-            std::cout << "Node before assign: " << depth << std::endl;
-            for(int k = 0; k < assigned.size(); k++) {
-                std::cout << assigned[k] << " ";
-            }
-            std::cout << std::endl;
             // Assigned mapping to node
             assigned[node] = candidate;
             used[candidate] = true;
-            // dive in
-            std::cout << "Node after assign: " << depth << std::endl;
-            for(int k = 0; k < assigned.size(); k++) {
-                std::cout << assigned[k] << " ";
+
+            // Node gets only the candidate, nobody else can get it, then propagate to the rest
+            std::vector<NodeSet> childDomains = domains;
+            std::vector<int> changed(1, node);
+            childDomains[node] = NodeSet(search.N);
+            childDomains[node].set(candidate);
+            for(size_t j = 0; j < search.order.size(); j++) {
+                int other = search.order[j];
+                if(other != node && childDomains[other].test(candidate)) {
+                    childDomains[other].reset(candidate);
+                    changed.push_back(other);
+                }
             }
-            std::cout << std::endl;
-            std::cout << std::endl;
+            std::vector<int> childMatchOf = matchOf;
             
-            res = checkScheme(depth+1, N, candidates, compAdjList, cableTypesCTU, assigned, used);
+            // dive in
+            if(!propagateDomains(search, childDomains, assigned, changed)) {
+                stats.prunedPropagation++;
+            } else if(!hasInjectiveMapping(search, childDomains, childMatchOf)) {
+                stats.prunedMatching++;
+            } else {
+                res = checkScheme(depth+1, search, childDomains, childMatchOf, assigned, used, stats);
+            }
             if(res == true) {
                 return true;
             }
             assigned[node] = -1;
             used[candidate] = false;
+            if(stats.outOfBudget) {
+                return false;
+            }
+        } else {
+            stats.prunedCable++;
         }
+        orbitFailed[orbitOf[candidate]] = true;
     }
 
     return res;
@@ -164,8 +859,7 @@ int main() {
     
     // Load number of company schemes
     std::cin >> S;
-    std::vector<std::vector<std::tuple<int, int, int>>> compSchemes;
-    compSchemes.reserve(S);
+    std::vector<std::vector<std::tuple<int, int, int>>> compSchemes(S);
 
     // Load edges of all companies schemes
     loadCompSchemesEdges(compSchemes, S);
@@ -175,42 +869,162 @@ int main() {
     //     std::cout << std::endl;
     // }
 
-    std::vector<std::vector<std::tuple<int, int>>> compAdjList(compSchemes[0].size() + 1);
-    // printEdges(compSchemes[0]);
-    createAdjacencyList(compSchemes[3], compAdjList);
+    // A scheme matches when an automorphism of the CTU network without cable types maps every scheme cable
+    // onto a CTU cable of the same type. Typed automorphisms are the same for every scheme, compute them once
+    std::vector<std::vector<std::tuple<int, int>>> cableList;
+    createCableList(cableTypesCTU, N, cableList);
+    std::vector<std::vector<int>> generators;
+    computeAutomorphisms(cableTypesCTU, cableList, N, generators);
 
-    printAdjacencyList(compAdjList);
-    
-    std::vector<std::vector<int>> candidates{
-        {0, 1, 2, 3},
-        {0, 1, 2, 3},
-        {0, 1, 2, 3},
-        {0, 1, 2, 3}
-    };
-
-    int node = 0;
-    std::vector<int> candidatesForNode = candidates[node];
-    std::vector<int> assigned(N, -1);
-    std::vector<bool> used(N, false);
-
-    bool res = checkScheme(0, N, candidates, compAdjList, cableTypesCTU, assigned, used);
-
-    if(res == true) {
-        std::cout << "True" << std::endl;
-    } else {
-        std::cout << "False" << std::endl;
-    }
-
-    // for(int i = 0; i < candidatesForNode.size(); i++) {
-    //     int candidate = candidatesForNode[i];
-    //     bool isMapPossible = checkPossibleMapping(node, candidate, compAdjList, cableTypesCTU, assigned);
-
-    //     if(isMapPossible) {
-    //         // Assigned mapping to node
-    //         assigned[node] = candidate;
-    //         // dive in
-    //     }
-    // }
+    // CTU cables with type 0 (any), an untyped automorphism keeps every server within its untyped colour
+    std::vector<std::vector<std::tuple<int, int>>> anyCableList = cableList;
+    for(int i = 0; i < N; i++) {
+        for(size_t j = 0; j < anyCableList[i].size(); j++) {
+            std::get<1>(anyCableList[i][j]) = 0;
+        }
+    }
+    std::vector<int> untypedColours(N, 0);
+    long long refinementWork = 0;
+    refineColours(untypedColours, anyCableList, refinementWork);
+
+    // CTU neighbours of every server by cable type, for bitset propagation
+    int maxType = 0;
+    for(size_t i = 0; i < edgesCTU.size(); i++) {
+        maxType = std::max(maxType, std::get<2>(edgesCTU[i]));
+    }
+    for(int s = 0; s < S; s++) {
+        for(size_t i = 0; i < compSchemes[s].size(); i++) {
+            maxType = std::max(maxType, std::get<2>(compSchemes[s][i]));
+        }
+    }
+    std::vector<std::vector<NodeSet>> cableNeighbours;
+    computeCableNeighbours(cableTypesCTU, N, maxType, cableNeighbours);
+
+    // Optional per-scheme budget, a scheme that runs out of it is reported as unknown, 0 means no limit
+    long long nodeBudget = 0;
+    double timeBudgetMs = 0;
+    const char* nodeBudgetEnv = std::getenv("PAL_BUDGET_NODES");
+    if (nodeBudgetEnv != nullptr) {
+        char* end;
+        long long value = std::strtoll(nodeBudgetEnv, &end, 10);
+        if (end != nodeBudgetEnv && *end == '\0' && value >= 0) {
+            nodeBudget = value;
+        } else {
+            std::cerr << "Invalid node budget, searching without a limit: " << nodeBudgetEnv << std::endl;
+        }
+    }
+    const char* timeBudgetEnv = std::getenv("PAL_BUDGET_MS");
+    if (timeBudgetEnv != nullptr) {
+        char* end;
+        double value = std::strtod(timeBudgetEnv, &end);
+        if (end != timeBudgetEnv && *end == '\0' && std::isfinite(value) && value >= 0) {
+            timeBudgetMs = value;
+        } else {
+            std::cerr << "Invalid time budget, searching without a limit: " << timeBudgetEnv << std::endl;
+        }
+    }
+
+    std::vector<int> matchingSchemes;
+    std::vector<SearchStats> stats(S);
+    std::vector<int> results(S);    // 0 no, 1 yes, 2 unknown
+    for(int s = 0; s < S; s++) {
+        SearchStats& st = stats[s];
+        st.nodeBudget = nodeBudget;
+        st.timeBudgetMs = timeBudgetMs;
+        st.start = std::chrono::steady_clock::now();
+
+        SchemeSearch search;
+        search.N = N;
+        search.cableTypesCTU = &cableTypesCTU;
+        search.cableNeighbours = &cableNeighbours;
+        search.generators = &generators;
+        search.untypedColours = &untypedColours;
+
+        // Every scheme cable has to be a CTU cable and fixes its type, the other CTU cables take any type
+        search.compAdjList = anyCableList;
+        bool consistent = true;
+        for(size_t i = 0; i < compSchemes[s].size() && consistent; i++) {
+            int n1, n2, type;
+            std::tie(n1, n2, type) = compSchemes[s][i];
+            consistent = cableTypesCTU[n1][n2] != 0;
+            for(int end = 0; end < 2 && consistent; end++) {
+                for(size_t j = 0; j < search.compAdjList[n1].size(); j++) {
+                    int& requiredType = std::get<1>(search.compAdjList[n1][j]);
+                    if(std::get<0>(search.compAdjList[n1][j]) == n2) {
+                        consistent = requiredType == 0 || requiredType == type;
+                        requiredType = type;
+                    }
+                }
+                std::swap(n1, n2);
+            }
+        }
+
+        // Servers without cables fit anywhere, only connected ones are searched
+        for(int i = 0; i < N; i++) {
+            if(!search.compAdjList[i].empty()) {
+                search.order.push_back(i);
+            }
+        }
+
+        std::vector<int> assigned(N, -1);
+        std::vector<bool> used(N, false);
+
+        // Candidates of every server, pruned before the search starts
+        std::vector<NodeSet> domains;
+        computeInitialDomains(search, maxType, domains);
+        std::vector<int> matchOf(N, -1);
+        bool res = false;
+        if(!consistent) {
+            st.prunedCable++;
+        } else if(!propagateDomains(search, domains, assigned, search.order)) {
+            st.prunedPropagation++;
+        } else if(!hasInjectiveMapping(search, domains, matchOf)) {
+            st.prunedMatching++;
+        } else {
+            res = checkScheme(0, search, domains, matchOf, assigned, used, st);
+        }
+
+        st.timeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - st.start).count();
+        results[s] = res ? 1 : st.outOfBudget ? 2 : 0;
+        if(res == true) {
+            matchingSchemes.push_back(s + 1);
+        }
+    }
+
+    // Schemes that ran out of budget are left out of the answer like non-matching ones, say which they are
+    std::vector<int> unknownSchemes;
+    for(int s = 0; s < S; s++) {
+        if(results[s] == 2) {
+            unknownSchemes.push_back(s + 1);
+        }
+    }
+    if(!unknownSchemes.empty()) {
+        std::cerr << "Search budget ran out, schemes left out of the answer as unknown:";
+        for(size_t i = 0; i < unknownSchemes.size(); i++) {
+            std::cerr << " " << unknownSchemes[i];
+        }
+        std::cerr << std::endl;
+    }
+
+    // Search statistics as JSON, to a file or to stderr for "-"
+    const char* statsPath = std::getenv("PAL_STATS");
+    if(statsPath != nullptr) {
+        if(std::string(statsPath) == "-") {
+            printStatsJson(std::cerr, stats, results);
+        } else {
+            std::ofstream statsFile(statsPath);
+            if(!statsFile) {
+                std::cerr << "Cannot open PAL_STATS file: " << statsPath << std::endl;
+            } else {
+                printStatsJson(statsFile, stats, results);
+            }
+        }
+    }
+
+    for(int i = 0; i < matchingSchemes.size(); i++) {
+        std::cout << (i > 0 ? " " : "") << matchingSchemes[i];
+    }
+    std::cout << std::endl;
     
     return 0;
 }
\ No newline at end of file
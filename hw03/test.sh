@@ -2,54 +2,72 @@
 
 g++ hw03.cpp -o ./bin/hw03;
 
-./bin/hw03 < datapub/pub02.in;
-
-# # Test01 Mandatory
-# ./bin/hw02 < datapub/pub01.in > datapub/my-pub01.out;
-# unix2dos datapub/my-pub01.out
-# diff datapub/pub01.out datapub/my-pub01.out;
-
-# # Test02 Mandatory
-# ./bin/hw02 < datapub/pub02.in > datapub/my-pub02.out;
-# unix2dos datapub/my-pub02.out
-# diff datapub/pub02.out datapub/my-pub02.out;
-
-# # Test03 Mandatory
-# ./bin/hw02 < datapub/pub03.in > datapub/my-pub03.out;
-# unix2dos datapub/my-pub03.out
-# diff datapub/pub03.out datapub/my-pub03.out;
-
-# # Test04 Mandatory
-# ./bin/hw02 < datapub/pub04.in > datapub/my-pub04.out;
-# unix2dos datapub/my-pub04.out
-# diff datapub/pub04.out datapub/my-pub04.out;
-
-# # # Test05 Mandatory
-# ./bin/hw02 < datapub/pub05.in > datapub/my-pub05.out;
-# unix2dos datapub/my-pub05.out
-# diff datapub/pub05.out datapub/my-pub05.out;
-
-# # Test06 Mandatory
-# ./bin/hw02 < datapub/pub06.in > datapub/my-pub06.out;
-# unix2dos datapub/my-pub06.out
-# diff datapub/pub06.out datapub/my-pub06.out;
-
-# # Test07 Mandatory
-# ./bin/hw02 < datapub/pub07.in > datapub/my-pub07.out;
-# unix2dos datapub/my-pub07.out
-# diff datapub/pub07.out datapub/my-pub07.out;
-
-# # Test08 Mandatory
-# ./bin/hw02 < datapub/pub08.in > datapub/my-pub08.out;
-# unix2dos datapub/my-pub08.out
-# diff datapub/pub08.out datapub/my-pub08.out;
-
-# # Test09 Mandatory
-# ./bin/hw02 < datapub/pub09.in > datapub/my-pub09.out;
-# unix2dos datapub/my-pub09.out
-# diff datapub/pub09.out datapub/my-pub09.out;
-
-# # Test10 Mandatory
-# ./bin/hw02 < datapub/pub10.in > datapub/my-pub10.out;
-# unix2dos datapub/my-pub10.out
-# diff datapub/pub10.out datapub/my-pub10.out;
\ No newline at end of file
+# Every test runs with each SIMD level forced (a level the CPU lacks falls back to the best one it has)
+for mode in PAL_SIMD=scalar PAL_SIMD=sse4.2 PAL_SIMD=avx2 PAL_SIMD=avx512; do
+    echo "$mode"
+
+    # Test01 Mandatory
+    env $mode ./bin/hw03 < datapub/pub01.in > datapub/my-pub01.out;
+    unix2dos datapub/my-pub01.out
+    diff --strip-trailing-cr datapub/pub01.out datapub/my-pub01.out;
+
+    # Test02 Mandatory
+    env $mode ./bin/hw03 < datapub/pub02.in > datapub/my-pub02.out;
+    unix2dos datapub/my-pub02.out
+    diff --strip-trailing-cr datapub/pub02.out datapub/my-pub02.out;
+
+    # Test03 Mandatory
+    env $mode ./bin/hw03 < datapub/pub03.in > datapub/my-pub03.out;
+    unix2dos datapub/my-pub03.out
+    diff --strip-trailing-cr datapub/pub03.out datapub/my-pub03.out;
+
+    # Test04 Mandatory
+    env $mode ./bin/hw03 < datapub/pub04.in > datapub/my-pub04.out;
+    unix2dos datapub/my-pub04.out
+    diff --strip-trailing-cr datapub/pub04.out datapub/my-pub04.out;
+
+    # Test05 Mandatory
+    env $mode ./bin/hw03 < datapub/pub05.in > datapub/my-pub05.out;
+    unix2dos datapub/my-pub05.out
+    diff --strip-trailing-cr datapub/pub05.out datapub/my-pub05.out;
+
+    # Test06 Mandatory
+    env $mode ./bin/hw03 < datapub/pub06.in > datapub/my-pub06.out;
+    unix2dos datapub/my-pub06.out
+    diff --strip-trailing-cr datapub/pub06.out datapub/my-pub06.out;
+
+    # Test07 Mandatory
+    env $mode ./bin/hw03 < datapub/pub07.in > datapub/my-pub07.out;
+    unix2dos datapub/my-pub07.out
+    diff --strip-trailing-cr datapub/pub07.out datapub/my-pub07.out;
+
+    # Test08 Mandatory
+    env $mode ./bin/hw03 < datapub/pub08.in > datapub/my-pub08.out;
+    unix2dos datapub/my-pub08.out
+    diff --strip-trailing-cr datapub/pub08.out datapub/my-pub08.out;
+
+    # Test09 Mandatory
+    env $mode ./bin/hw03 < datapub/pub09.in > datapub/my-pub09.out;
+    unix2dos datapub/my-pub09.out
+    diff --strip-trailing-cr datapub/pub09.out datapub/my-pub09.out;
+
+    # Test10 Mandatory
+    env $mode ./bin/hw03 < datapub/pub10.in > datapub/my-pub10.out;
+    unix2dos datapub/my-pub10.out
+    diff --strip-trailing-cr datapub/pub10.out datapub/my-pub10.out;
+
+    # Test11 Mandatory
+    env $mode ./bin/hw03 < datapub/pub11.in > datapub/my-pub11.out;
+    unix2dos datapub/my-pub11.out
+    diff --strip-trailing-cr datapub/pub11.out datapub/my-pub11.out;
+
+    # Test12 Mandatory
+    env $mode ./bin/hw03 < datapub/pub12.in > datapub/my-pub12.out;
+    unix2dos datapub/my-pub12.out
+    diff --strip-trailing-cr datapub/pub12.out datapub/my-pub12.out;
+
+    # Test13 Mandatory (more than 256 servers)
+    env $mode ./bin/hw03 < datapub/pub13.in > datapub/my-pub13.out;
+    unix2dos datapub/my-pub13.out
+    diff --strip-trailing-cr datapub/pub13.out datapub/my-pub13.out;
+done
\ No newline at end of file